@@ -7,152 +7,354 @@
 #define F_CPU 20000000UL
 #include "capi324v221.h"
 #include<avr/interrupt.h>
+#include "usart.h"
+#include "proto.h"
+#include "tick.h"
+#include "stepeng.h"
+#include "steppwr.h"
+#include "motion.h"
+#include "kin.h"
+#include "odom.h"
+#include "latency.h"
+#include "idle.h"
+#include "lcdfb.h"
+#include "screens.h"
+#include "fmt.h"
+#include "dash.h"
 
+/* Serial Commands */
+#define BACKWARD	PROTO_OP_BACKWARD
+#define FORWARD		PROTO_OP_FORWARD
+#define TURNRIGHT	PROTO_OP_TURNRIGHT
+#define TURNLEFT	PROTO_OP_TURNLEFT
+#define TURNAROUND	PROTO_OP_TURNAROUND
+#define STOP		PROTO_OP_STOP
+#define MOVE		PROTO_OP_MOVE
 
-/* UART calcs */
-#define BAUD 9600UL
-#define MYUBRR (F_CPU/(16*BAUD))-1 
+/* Pivot turns: wheel speed in mm/s and acceleration in mm/s^2, the old
+ * 200 steps/s and 400 steps/s^2 with the default calibration. */
+#define TURN_SPEED	239
+#define TURN_ACCEL	479
 
-/* Serial Commands */
-#define BACKWARD	1
-#define FORWARD		2
-#define TURNRIGHT	3
-#define TURNLEFT	4
-#define TURNAROUND	5
-#define STOP		0
+/* Driving forward and backward: speed in steps/s, and the rates the speed
+ * is slewed at in steps/s^2, speeding up and slowing down (including
+ * through a reversal). */
+#define DRIVE_SPEED	150
+#define DRIVE_ACCEL	400
+#define DRIVE_DECEL	600
+
+/* State table entry.  'entry' runs once when the state is entered and
+ * 'exit' once when it is left; either may be NULL.  A state with a 'done'
+ * test is transient (the turns): its entry action starts a maneuver without
+ * waiting, the main loop polls 'done', and once it returns non-zero control
+ * goes back to the last steady state.  Any command that arrives meanwhile
+ * preempts the maneuver through its exit action. */
+typedef struct STATE_ENTRY_TYPE {
 
+	void ( *entry )( void );
+	void ( *exit )( void );
+	uint8_t ( *done )( void );
+	const LCDFB_SCREEN *pScreen;	// Shown on the LCD by the transition action.
+
+} STATE_ENTRY;
 
 /* FUNCTION PROTOTYPES */
 void goForward();
 void goBackward();
+void releaseDrive();
 void turnRight();
 void turnLeft();
 void turnAround();
-void resumePrev( uint8_t prev_state);
+uint8_t changeState( uint8_t next );
+void enterState( uint8_t next );
+uint8_t turnDone();
 void stop();
 void makeSandwich();
-void USART_Init( unsigned int ubrr);
 
-/* Global Variables */
-volatile char cmd;
-volatile uint8_t rxflag;
+/* Indexed by command; must follow the values of the Serial Commands. */
+static const STATE_ENTRY state_table[] = {
+
+	/* STOP */			{ stop,			NULL,			NULL,		&SCREEN_STOP },
+	/* BACKWARD */		{ goBackward,	releaseDrive,	NULL,		&SCREEN_BACKWARD },
+	/* FORWARD */		{ goForward,	releaseDrive,	NULL,		&SCREEN_FORWARD },
+	/* TURNRIGHT */		{ turnRight,	stop,			turnDone,	&SCREEN_TURNRIGHT },
+	/* TURNLEFT */		{ turnLeft,		stop,			turnDone,	&SCREEN_TURNLEFT },
+	/* TURNAROUND */	{ turnAround,	stop,			turnDone,	&SCREEN_TURNAROUND },
+	/* MOVE */			{ MOTION_start,	MOTION_flush,	NULL,		&SCREEN_MOVE }
+};
+
+#define NUM_STATES	( sizeof( state_table ) / sizeof( state_table[ 0 ] ) )
+
+static uint8_t state = STOP;
+static uint8_t resume_state = STOP;	// Last steady state but MOVE, resumed after a turn.
+
+/* Main loop passes counted over the last full second. */
+static uint32_t loop_rate;
 
 void CBOT_main( void )
 {	
 	/* Local Variable Declaration */
-	uint8_t state = 0;
-	uint8_t prev_state = 0;
+	PROTO_FRAME *pFrame;
+	MOTION_STATS mstats;
+	LATENCY_STOP lstop;
+	IDLE_STATS istats;
+	ODOM_POSE pose;
+	STEPPWR_STATS pstats;
+	STEPENG_LOAD sload;
+#if FMT_BENCH
+	FMT_BENCH_RESULT fbench;
+#endif
+#if STEPENG_BENCH
+	STEPENG_BENCH_RESULT sbench;
+#endif
+	uint8_t hist_reply[1 + sizeof(LATENCY_HIST)];
+	uint8_t moving;
+	uint8_t dash_on = 0;	// The banner stays up until the first command.
+	uint8_t hooked;
+	TIMEROBJ rate_timer;
+	uint32_t loops = 0;
 	
 	/* Setting Up */
 	LCD_open();			// Open and initialize the LCD-subsystem.
-	STEPPER_open();     // Open STEPPER module for use.
+	STEPENG_open( STEPENG_TIMER );	// Open STEPPER module, steps timed by Timer1.
+	STEPENG_set_ramp( STEPPER_BOTH, DRIVE_ACCEL, DRIVE_DECEL );
 	USART_Init(MYUBRR);
+	PROTO_init();
+	TICK_open();
+	hooked = MOTION_open();
+	hooked &= ODOM_open();
+	hooked &= STEPPWR_open();
+	hooked &= LATENCY_open();
+	IDLE_open();
+	LCDFB_open();
+	
+	/* Without its tick services the robot would not stop or finish a
+	 * move, so do not run at all.  tick.h checks the count at compile
+	 * time; this catches a hook attached without counting it there. */
+	if (!hooked)
+	{
+		LCDFB_puts_P( 0, 0, PSTR( "Out of tick hooks" ) );
+		LCDFB_flush();
+		while( 1 )
+			;
+	}
+	
+	LCDFB_show( &SCREEN_BANNER );	// Print a message.
+	LCDFB_flush();
+	DASH_open();
 	
-	LCD_clear();		// Clear the LCD.
-	LCD_printf( "Try saying:\n\"CEENbot Go\"" );// Print a message.
+	rate_timer.tc = 0;
+	TMRSRVC_new( &rate_timer, TMRFLG_NOTIFY_FLAG, TMR_TCM_RESTART, 1000 );
 	
 	while( 1 )
 	{
-		if (rxflag)
+		/* Take one command frame per pass.  Nothing below blocks, so a
+		 * command is seen within one pass even during a turn.  Actions
+		 * only run when the state actually changes. */
+		if ((pFrame = PROTO_poll()) != 0)
 		{
-			prev_state = state;
-			state = cmd;
-			rxflag = 0;
-		}			
-		switch (state) 
+			LATENCY_begin(pFrame->op, pFrame->rx_mark);
+			moving = 0;
+			
+			if (pFrame->op == STOP)
+				LATENCY_stop_begin(pFrame->rx_mark);
+			else if (pFrame->op < NUM_STATES)
+				LATENCY_stop_cancel();
+			
+			if (pFrame->op < NUM_STATES)
+				dash_on = 1;
+			
+			if (pFrame->op == MOVE)
+			{
+				/* Segments go to the queue; entering MOVE (if not there
+				 * already) lets the tick start on them. */
+				switch (MOTION_enqueue(pFrame->payload, pFrame->len))
+				{
+					case MOTION_OK:
+						PROTO_ack(pFrame);
+						changeState(MOVE);
+						moving = 1;
+						break;
+					case MOTION_ERR_FULL:
+						PROTO_nak(pFrame->seq, PROTO_NAK_BUSY);
+						break;
+					default:
+						PROTO_nak(pFrame->seq, PROTO_NAK_PARAM);
+						break;
+				}
+			}
+			else if (pFrame->op < NUM_STATES)
+			{
+				PROTO_ack(pFrame);
+				moving = changeState(pFrame->op) && (pFrame->op != STOP);
+			}
+			else if (pFrame->op == PROTO_OP_GET_LOOP_RATE)
+				PROTO_reply(pFrame, (const uint8_t *) &loop_rate, sizeof(loop_rate));
+			else if (pFrame->op == PROTO_OP_GET_MOTION_STATS)
+			{
+				MOTION_get_stats(&mstats);
+				PROTO_reply(pFrame, (const uint8_t *) &mstats, sizeof(mstats));
+			}
+			else if (pFrame->op == PROTO_OP_GET_STOP_LATENCY)
+			{
+				LATENCY_get_stop(&lstop);
+				PROTO_reply(pFrame, (const uint8_t *) &lstop, sizeof(lstop));
+			}
+			else if (pFrame->op == PROTO_OP_GET_LATENCY_HIST &&
+					 pFrame->len == 1 && pFrame->payload[0] < LATENCY_ROWS)
+			{
+				/* Reply: row, then its histograms, which are cleared. */
+				hist_reply[0] = pFrame->payload[0];
+				LATENCY_get_hist(pFrame->payload[0], (LATENCY_HIST *) &hist_reply[1]);
+				PROTO_reply(pFrame, hist_reply, sizeof(hist_reply));
+			}
+			else if (pFrame->op == PROTO_OP_GET_IDLE_STATS)
+			{
+				IDLE_get_stats(&istats);
+				PROTO_reply(pFrame, (const uint8_t *) &istats, sizeof(istats));
+			}
+			else if (pFrame->op == PROTO_OP_GET_POSE)
+			{
+				ODOM_get(&pose);
+				PROTO_reply(pFrame, (const uint8_t *) &pose, sizeof(pose));
+			}
+			else if (pFrame->op == PROTO_OP_GET_POWER_STATS)
+			{
+				STEPPWR_get_stats(&pstats);
+				PROTO_reply(pFrame, (const uint8_t *) &pstats, sizeof(pstats));
+			}
+			else if (pFrame->op == PROTO_OP_GET_STEP_LOAD)
+			{
+				STEPENG_get_load(&sload);
+				PROTO_reply(pFrame, (const uint8_t *) &sload, sizeof(sload));
+			}
+#if FMT_BENCH
+			else if (pFrame->op == PROTO_OP_GET_FMT_BENCH)
+			{
+				FMT_bench(&fbench);
+				PROTO_reply(pFrame, (const uint8_t *) &fbench, sizeof(fbench));
+			}
+#endif
+#if STEPENG_BENCH
+			else if (pFrame->op == PROTO_OP_GET_STEP_BENCH)
+			{
+				STEPENG_bench(&sbench);
+				PROTO_reply(pFrame, (const uint8_t *) &sbench, sizeof(sbench));
+			}
+#endif
+			else
+				PROTO_nak(pFrame->seq, PROTO_NAK_OPCODE);
+			
+			LATENCY_dispatch(moving);
+		}
+		
+		/* A finished turn hands back to the state it interrupted. */
+		if (state_table[state].done && state_table[state].done())
 		{
-			case FORWARD: /* Command to Go Forward */
-				goForward();
-				LCD_clear();
-				printf("Forward");
-				break;
-			case BACKWARD: /* Command to Reverse */
-				goBackward();
-				LCD_clear();
-				printf("Backward");
-				break;
-			case TURNRIGHT: /* Command to turn right */
-				turnRight();
-				LCD_clear();
-				printf("Turn Right");
-				resumePrev(prev_state);
-				state = prev_state;
-				break;
-			case TURNLEFT:/* Command to turn left */
-				turnLeft();
-				LCD_clear();
-				printf("Turn Left");
-				resumePrev(prev_state);
-				state = prev_state;
-				break;
-			case TURNAROUND: /* Command to do a U-turn */
-				turnAround();
-				LCD_clear();
-				printf("Turn Around");
-				resumePrev(prev_state);
-				state = prev_state;
-				break;
-			case STOP:
-				stop();
-				LCD_clear();
-				printf("Stop");
-				break;
-			default: /* execute default action */
-				stop();
-				LCD_clear();
-				printf("DEFAULT STATE");
-				break;
+			state_table[state].exit();
+			enterState(resume_state);
 		}
-		//STEPPER_wait_on( STEPPER_BOTH );
-		//_delay_ms(5000);
-		//cmd++;
+		
+		/* Transition action: the dashboard shows the new state on its next
+		 * redraw, which is paced by its own timer.  Only the framebuffer
+		 * is drawn here; the flush sends the changed columns from the SPI
+		 * interrupt, or next pass if one is still running. */
+		if (dash_on)
+			DASH_task( state_table[ state ].pScreen );
+		LCDFB_flush();
+		
+		loops++;
+		TMRSRVC_on_TC( rate_timer, { loop_rate = loops; loops = 0; } );
+		
+		/* Nothing left to do until the next interrupt: a received byte,
+		 * the system tick (which also finishes turns and runs timers) or a
+		 * transmit slot. */
+		if (!pFrame)
+			IDLE_sleep();
 	}
 } // end CBOT_main()
 
+/* Run the exit action of the current state, then enter 'next'.  Repeating
+ * the current command does nothing, so a running ramp is never restarted.
+ * Returns 1 if the state changed. */
+uint8_t changeState( uint8_t next )
+{
+	if( next == state )
+		return 0;
+
+	if( state_table[ state ].exit )
+		state_table[ state ].exit();
+
+	/* MOVE's exit flushes its queue, so there is nothing to go back to:
+	 * a turn that preempts a move ends stopped. */
+	if( !state_table[ state ].done )
+		resume_state = ( state == MOVE ) ? STOP : state;
+
+	enterState( next );
+
+	return 1;
+}
+
+/* Run the entry action of 'next'.  The main loop updates the LCD. */
+void enterState( uint8_t next )
+{
+	state = next;
+
+	if( state_table[ state ].entry )
+		state_table[ state ].entry();
+}
+
 /* Directional code
- * I made this for the sole reason of wanting to type less */
+ * I made this for the sole reason of wanting to type less
+ *
+ * Forward and backward set a velocity target that the tick slews to from
+ * whatever speed the wheels have, so resuming after a turn ramps up and a
+ * reversal runs down through zero.  Leaving the state hands the wheels
+ * back at their current speed. */
 void goForward()
 {
-	STEPPER_run( STEPPER_BOTH, STEPPER_FWD, 150 );
+	STEPENG_set_velocity( STEPPER_BOTH, DRIVE_SPEED );
 }
 
 void goBackward()
 {
-	STEPPER_run( STEPPER_BOTH, STEPPER_REV, 150 );
+	STEPENG_set_velocity( STEPPER_BOTH, -DRIVE_SPEED );
+}
+
+void releaseDrive()
+{
+	STEPENG_release( STEPPER_BOTH );
 }
 
 void turnLeft()
 {
-	//TURN LEFT (~90-degrees)...
-	STEPPER_move_stwt( STEPPER_BOTH,
-		STEPPER_REV, 150, 200, 400, STEPPER_BRK_OFF,   // Left
-		STEPPER_FWD, 150, 200, 400, STEPPER_BRK_OFF ); // Right
+	MOTION_SEG seg;
+
+	KIN_pivot( &seg, 90, TURN_SPEED, TURN_ACCEL );
+	KIN_move( &seg );
 }
 
 void turnRight()
 {
-	//TURN RIGHT (~90-degrees)...
-	STEPPER_move_stwt( STEPPER_BOTH,
-		STEPPER_FWD, 150, 200, 400, STEPPER_BRK_OFF,   // Left
-		STEPPER_REV, 150, 200, 400, STEPPER_BRK_OFF ); // Right
+	MOTION_SEG seg;
+
+	KIN_pivot( &seg, -90, TURN_SPEED, TURN_ACCEL );
+	KIN_move( &seg );
 }
 
 void turnAround()
 {
-	//TURN RIGHT (~180-degrees)...
-	STEPPER_move_stwt( STEPPER_BOTH,
-		STEPPER_FWD, 300, 200, 400, STEPPER_BRK_OFF,   // Left
-		STEPPER_REV, 300, 200, 400, STEPPER_BRK_OFF ); // Right
+	MOTION_SEG seg;
+
+	KIN_pivot( &seg, -180, TURN_SPEED, TURN_ACCEL );
+	KIN_move( &seg );
 }
 
-void resumePrev( uint8_t prev_state )
+/* Turns are started without blocking; both wheels report through
+ * step_done when their steps are complete. */
+uint8_t turnDone()
 {
-	if(prev_state == FORWARD)
-		goForward();
-	else if(prev_state == BACKWARD)
-		goBackward();
-	else if(prev_state == STOP )
-		stop();
+	return step_done.left && step_done.right;
 }
 
 void stop()
@@ -164,20 +366,3 @@ void makeSandwich()
 {
 	//It really doesn't make you a sandwich.
 }
-
-/* USART Functions */
-void USART_Init( unsigned int ubrr)
-{
-	/*Set baud rate */
-    UBRR0H = (ubrr >> 8);
-    UBRR0L = ubrr;
-    
-    UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);      // Enable receiver and transmitter and interrupt receive
-    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);    // Set frame: 8data, 1 stp
-}
-
-ISR(USART0_RX_vect)
-{
-   cmd = UDR0; // Fetch the received byte value into the variable "ByteReceived"
-   rxflag = 1;
-}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * dash.c
+ *
+ * Timer-paced LCD dashboard with per-widget change detection.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include "lcdfb.h"
+#include "fmt.h"
+#include "motion.h"
+#include "dash.h"
+
+static TIMEROBJ dash_timer;
+
+/* Values on the screen.  'shown' is cleared to force a full redraw. */
+static uint8_t shown;
+static const LCDFB_SCREEN *shown_state;
+static int16_t shown_left;
+static int16_t shown_right;
+static uint8_t shown_depth;
+
+static void DASH_redraw( const LCDFB_SCREEN *pState )
+{
+	STEPPER_SPEED speed = STEPPER_get_curr_speed();
+	MOTION_STATS mstats;
+	FMT_SINK sink;
+
+	MOTION_get_stats( &mstats );
+
+	if( !shown )
+	{
+		LCDFB_clear();
+		FMT_lcd( &sink, 1, 0 );
+		FMT_c( &sink, 'L' );
+		FMT_lcd( &sink, 1, 7 );
+		FMT_c( &sink, 'R' );
+		FMT_lcd( &sink, 2, 0 );
+		FMT_s_P( &sink, PSTR( "Queue" ) );
+	}
+
+	if( !shown || pState != shown_state )
+	{
+		LCDFB_show_row( 0, &pState->rows[ 0 ], LCD_nCOLS );
+		shown_state = pState;
+	}
+
+	if( !shown || speed.left != shown_left )
+	{
+		FMT_lcd( &sink, 1, 1 );
+		FMT_i16( &sink, speed.left, 5 );
+		shown_left = speed.left;
+	}
+
+	if( !shown || speed.right != shown_right )
+	{
+		FMT_lcd( &sink, 1, 8 );
+		FMT_i16( &sink, speed.right, 5 );
+		shown_right = speed.right;
+	}
+
+	if( !shown || mstats.depth != shown_depth )
+	{
+		FMT_lcd( &sink, 2, 6 );
+		FMT_u16( &sink, mstats.depth, 2 );
+		FMT_c( &sink, '/' );
+		FMT_u16( &sink, MOTION_QUEUE_SIZE, 0 );
+		shown_depth = mstats.depth;
+	}
+
+	shown = 1;
+}
+
+void DASH_open( void )
+{
+	dash_timer.tc = 0;
+	TMRSRVC_new( &dash_timer, TMRFLG_NOTIFY_FLAG, TMR_TCM_RESTART, DASH_RATE_MS );
+}
+
+void DASH_task( const LCDFB_SCREEN *pState )
+{
+	TMRSRVC_on_TC( dash_timer, DASH_redraw( pState ) );
+}
@@ -0,0 +1,37 @@
+/*
+ * dash.h
+ *
+ * LCD dashboard.  A TIMEROBJ paces the redraws at DASH_RATE_MS, however
+ * often commands arrive, and each redraw only touches the widgets whose
+ * value changed since the last one:
+ *
+ *     row 0 - state label
+ *     row 1 - current left and right stepper speed (steps/s)
+ *     row 2 - MOVE segments waiting in the queue
+ *
+ * Everything is drawn into the LCD framebuffer and sent by LCDFB_flush(),
+ * so a redraw costs at most one screenful of SPI bytes, usually a few.
+ *
+ * There is no battery widget: the API build has no power manager, and the
+ * board's battery channel and divider are not documented, so a level
+ * could only be shown from guessed ADC codes.
+ */
+#ifndef DASH_H_
+#define DASH_H_
+
+#include <stdint.h>
+#include "lcdfb.h"
+
+#ifndef DASH_RATE_MS
+	#define DASH_RATE_MS	250		// Redraw period.
+#endif
+
+/* Start the redraw timer.  Call once, after LCDFB_open(). */
+void DASH_open( void );
+
+/* Run from the main loop on every pass.  Redraws when the timer is due,
+ * showing row 0 of 'pState' as the state label.  The first redraw clears
+ * whatever was on the screen. */
+void DASH_task( const LCDFB_SCREEN *pState );
+
+#endif /* DASH_H_ */
@@ -0,0 +1,245 @@
+/*
+ * fmt.c
+ *
+ * Type-specialized formatter with LCD framebuffer and protocol text sinks.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include "lcdfb.h"
+#include "proto.h"
+#include "fmt.h"
+#if FMT_BENCH
+	#include <stdio.h>
+	#include <string.h>
+	#include "tick.h"
+#endif
+
+static const uint32_t pow10_32[ 10 ] PROGMEM = {
+
+	1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+	10000UL, 1000UL, 100UL, 10UL, 1UL
+};
+
+static const uint16_t pow10_16[ 5 ] PROGMEM = { 10000, 1000, 100, 10, 1 };
+
+static const char hex_digits[ 16 ] PROGMEM = "0123456789ABCDEF";
+
+static void put_lcd( FMT_SINK *pSink, char c )
+{
+	if( pSink->len < LCD_nCOLS )
+		LCDFB_putc( pSink->row, pSink->len++, c );
+}
+
+static void put_buf( FMT_SINK *pSink, char c )
+{
+	if( pSink->len < pSink->size )
+		pSink->pBuf[ pSink->len++ ] = c;
+}
+
+/* Decimal digits of 'v', most significant first, into 'pDigits'.  Returns
+ * their number (at least 1). */
+static uint8_t digits32( char *pDigits, uint32_t v )
+{
+	uint32_t p;
+	uint8_t n = 0;
+	uint8_t i;
+	char d;
+
+	for( i = 0; i < 10; i++ )
+	{
+		p = pgm_read_dword( &pow10_32[ i ] );
+
+		for( d = '0'; v >= p; d++ )
+			v -= p;
+
+		if( n || d != '0' || i == 9 )
+			pDigits[ n++ ] = d;
+	}
+
+	return n;
+}
+
+/* digits32() in 16-bit arithmetic. */
+static uint8_t digits16( char *pDigits, uint16_t v )
+{
+	uint16_t p;
+	uint8_t n = 0;
+	uint8_t i;
+	char d;
+
+	for( i = 0; i < 5; i++ )
+	{
+		p = pgm_read_word( &pow10_16[ i ] );
+
+		for( d = '0'; v >= p; d++ )
+			v -= p;
+
+		if( n || d != '0' || i == 4 )
+			pDigits[ n++ ] = d;
+	}
+
+	return n;
+}
+
+/* Write a number: sign, then 'n' digits with a point before the last 'dp',
+ * zero-extended on the left so at least one digit precedes the point, and
+ * all of it right-aligned in 'width'. */
+static void emit( FMT_SINK *pSink, uint8_t neg, const char *pDigits,
+	uint8_t n, uint8_t dp, uint8_t width )
+{
+	uint8_t lead = ( n <= dp ) ? dp + 1 - n : 0;
+	uint8_t total = lead + n;
+	uint8_t len = neg + total + ( dp ? 1 : 0 );
+	uint8_t k;
+
+	for( ; width > len; width-- )
+		pSink->put( pSink, ' ' );
+
+	if( neg )
+		pSink->put( pSink, '-' );
+
+	for( k = 0; k < total; k++ )
+	{
+		if( dp && k == total - dp )
+			pSink->put( pSink, '.' );
+
+		pSink->put( pSink, ( k < lead ) ? '0' : pDigits[ k - lead ] );
+	}
+}
+
+void FMT_lcd( FMT_SINK *pSink, uint8_t row, uint8_t col )
+{
+	pSink->put = put_lcd;
+	pSink->pBuf = NULL;
+	pSink->size = 0;
+	pSink->len = col;
+	pSink->row = row;
+}
+
+void FMT_buf( FMT_SINK *pSink, char *pBuf, uint8_t size )
+{
+	pSink->put = put_buf;
+	pSink->pBuf = pBuf;
+	pSink->size = size;
+	pSink->len = 0;
+	pSink->row = 0;
+}
+
+void FMT_send( FMT_SINK *pSink )
+{
+	PROTO_send( 0, PROTO_OP_TEXT, (const uint8_t *) pSink->pBuf, pSink->len );
+	pSink->len = 0;
+}
+
+void FMT_c( FMT_SINK *pSink, char c )
+{
+	pSink->put( pSink, c );
+}
+
+void FMT_s( FMT_SINK *pSink, const char *pStr )
+{
+	while( *pStr )
+		pSink->put( pSink, *pStr++ );
+}
+
+void FMT_s_P( FMT_SINK *pSink, PGM_P pStr )
+{
+	char c;
+
+	while( ( c = pgm_read_byte( pStr++ ) ) != 0 )
+		pSink->put( pSink, c );
+}
+
+void FMT_u16( FMT_SINK *pSink, uint16_t v, uint8_t width )
+{
+	char digits[ 5 ];
+
+	emit( pSink, 0, digits, digits16( digits, v ), 0, width );
+}
+
+void FMT_u32( FMT_SINK *pSink, uint32_t v, uint8_t width )
+{
+	char digits[ 10 ];
+
+	emit( pSink, 0, digits, digits32( digits, v ), 0, width );
+}
+
+void FMT_i16( FMT_SINK *pSink, int16_t v, uint8_t width )
+{
+	char digits[ 5 ];
+	uint8_t neg = ( v < 0 );
+
+	/* Negate unsigned so INT16_MIN comes out right. */
+	emit( pSink, neg, digits,
+		digits16( digits, neg ? -(uint16_t) v : (uint16_t) v ), 0, width );
+}
+
+void FMT_i32( FMT_SINK *pSink, int32_t v, uint8_t width )
+{
+	FMT_fix( pSink, v, 0, width );
+}
+
+void FMT_fix( FMT_SINK *pSink, int32_t v, uint8_t dp, uint8_t width )
+{
+	char digits[ 10 ];
+	uint8_t neg = ( v < 0 );
+
+	emit( pSink, neg, digits,
+		digits32( digits, neg ? -(uint32_t) v : (uint32_t) v ), dp, width );
+}
+
+void FMT_x8( FMT_SINK *pSink, uint8_t v )
+{
+	pSink->put( pSink, pgm_read_byte( &hex_digits[ v >> 4 ] ) );
+	pSink->put( pSink, pgm_read_byte( &hex_digits[ v & 0x0F ] ) );
+}
+
+void FMT_x16( FMT_SINK *pSink, uint16_t v )
+{
+	FMT_x8( pSink, v >> 8 );
+	FMT_x8( pSink, (uint8_t) v );
+}
+
+#if FMT_BENCH
+
+/* Values for the benchmark line; volatile so neither path is folded at
+ * compile time. */
+static volatile uint16_t bench_u = 1234;
+static volatile int32_t bench_i = -56789;
+static volatile uint16_t bench_x = 0xBEEF;
+
+void FMT_bench( FMT_BENCH_RESULT *pResult )
+{
+	char fmt_line[ 32 ];
+	char printf_line[ 32 ];
+	FMT_SINK sink;
+	uint32_t t0, t1;
+	uint8_t i;
+
+	t0 = TICK_stamp();
+	for( i = 0; i < FMT_BENCH_RUNS; i++ )
+	{
+		FMT_buf( &sink, fmt_line, sizeof( fmt_line ) );
+		FMT_s_P( &sink, PSTR( "Spd " ) );
+		FMT_u16( &sink, bench_u, 5 );
+		FMT_c( &sink, ' ' );
+		FMT_i32( &sink, bench_i, 7 );
+		FMT_s_P( &sink, PSTR( " 0x" ) );
+		FMT_x16( &sink, bench_x );
+	}
+	t1 = TICK_stamp();
+	pResult->fmt_cycles = ( ( t1 - t0 ) * 256 ) / FMT_BENCH_RUNS;
+
+	t0 = TICK_stamp();
+	for( i = 0; i < FMT_BENCH_RUNS; i++ )
+		snprintf_P( printf_line, sizeof( printf_line ), PSTR( "Spd %5u %7ld 0x%04X" ),
+			bench_u, (long) bench_i, bench_x );
+	t1 = TICK_stamp();
+	pResult->printf_cycles = ( ( t1 - t0 ) * 256 ) / FMT_BENCH_RUNS;
+
+	pResult->len = sink.len;
+	pResult->match = ( strlen( printf_line ) == sink.len ) &&
+					 ( memcmp( printf_line, fmt_line, sink.len ) == 0 );
+}
+
+#endif /* FMT_BENCH */
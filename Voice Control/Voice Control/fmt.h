@@ -0,0 +1,93 @@
+/*
+ * fmt.h
+ *
+ * Small text formatter used instead of printf().  There is one function
+ * per value type, so nothing parses a format string or walks a va_list at
+ * run time, and numbers are converted by subtracting powers of ten rather
+ * than by division.
+ *
+ * Output goes to a sink:
+ *
+ *     LCD    - draws into the LCD framebuffer (lcdfb.h) from a row/column,
+ *              clipped at the end of the row.  Flushed as usual.
+ *     Buffer - fills a caller-supplied buffer; FMT_send() then queues its
+ *              contents for the host as a PROTO_OP_TEXT frame on the USART0
+ *              transmit ring.  Raw text is never written to the UART, where
+ *              it would break the framing.
+ *
+ * A 'width' argument right-aligns the value in that many characters,
+ * padding with spaces; 0 means no padding.
+ */
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+/* Set to 1 to build FMT_bench() and answer PROTO_OP_GET_FMT_BENCH.  This
+ * links snprintf(), which the firmware otherwise does without. */
+#ifndef FMT_BENCH
+	#define FMT_BENCH		0
+#endif
+
+#define FMT_BENCH_RUNS		32		// Lines formatted per path and measurement.
+
+typedef struct FMT_SINK_TYPE FMT_SINK;
+
+struct FMT_SINK_TYPE {
+
+	void ( *put )( FMT_SINK *pSink, char c );
+	char *pBuf;				// Buffer sink: storage.
+	uint8_t size;			// Buffer sink: capacity.
+	uint8_t len;			// Buffer sink: characters stored.  LCD: column.
+	uint8_t row;			// LCD: text row.
+
+};
+
+/* Benchmark result, see FMT_bench().  Times include any interrupts taken
+ * meanwhile, equally for both paths. */
+typedef struct FMT_BENCH_RESULT_TYPE {
+
+	uint32_t fmt_cycles;	// CPU cycles per line through FMT_xxx().
+	uint32_t printf_cycles;	// CPU cycles per line through snprintf().
+	uint8_t len;			// Characters per line.
+	uint8_t match;			// 1 if both paths produced the same text.
+
+} FMT_BENCH_RESULT;
+
+/* Set up '*pSink' to draw into the LCD framebuffer at 'row', 'col'. */
+void FMT_lcd( FMT_SINK *pSink, uint8_t row, uint8_t col );
+
+/* Set up '*pSink' to fill 'pBuf' (not terminated).  Characters beyond
+ * 'size' are dropped. */
+void FMT_buf( FMT_SINK *pSink, char *pBuf, uint8_t size );
+
+/* Queue the contents of buffer sink 'pSink' as a PROTO_OP_TEXT frame and
+ * empty it. */
+void FMT_send( FMT_SINK *pSink );
+
+void FMT_c( FMT_SINK *pSink, char c );
+void FMT_s( FMT_SINK *pSink, const char *pStr );
+void FMT_s_P( FMT_SINK *pSink, PGM_P pStr );
+
+/* Decimal integers. */
+void FMT_u16( FMT_SINK *pSink, uint16_t v, uint8_t width );
+void FMT_u32( FMT_SINK *pSink, uint32_t v, uint8_t width );
+void FMT_i16( FMT_SINK *pSink, int16_t v, uint8_t width );
+void FMT_i32( FMT_SINK *pSink, int32_t v, uint8_t width );
+
+/* Fixed-point decimal: 'v' in units of 10^-'dp', printed with 'dp' digits
+ * after the point, e.g. FMT_fix( s, -1234, 2, 0 ) gives "-12.34". */
+void FMT_fix( FMT_SINK *pSink, int32_t v, uint8_t dp, uint8_t width );
+
+/* Upper-case hex, always 2 or 4 digits. */
+void FMT_x8( FMT_SINK *pSink, uint8_t v );
+void FMT_x16( FMT_SINK *pSink, uint16_t v );
+
+#if FMT_BENCH
+/* Format the same line FMT_BENCH_RUNS times through each path into RAM and
+ * time it; the LCD and UART transfers are left out of both. */
+void FMT_bench( FMT_BENCH_RESULT *pResult );
+#endif
+
+#endif /* FMT_H_ */
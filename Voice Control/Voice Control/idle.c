@@ -0,0 +1,51 @@
+/*
+ * idle.c
+ *
+ * Idle sleep with asleep/awake accounting.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "tick.h"
+#include "usart.h"
+#include "idle.h"
+
+static IDLE_STATS stats;
+static uint32_t opened;			// TICK_stamp() at IDLE_open().
+
+void IDLE_open( void )
+{
+	set_sleep_mode( SLEEP_MODE_IDLE );
+	opened = TICK_stamp();
+}
+
+void IDLE_sleep( void )
+{
+	uint32_t before;
+
+	before = TICK_stamp();
+
+	/* Check and sleep with interrupts off: the instruction after 'sei'
+	 * always executes, so a byte arriving after the check still wakes the
+	 * CPU instead of being left waiting for the next tick. */
+	cli();
+	if( USART_available() )
+	{
+		sei();
+		return;
+	}
+
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+
+	stats.asleep += TICK_stamp() - before;
+	stats.sleeps++;
+}
+
+void IDLE_get_stats( IDLE_STATS *pStats )
+{
+	stats.awake = ( TICK_stamp() - opened ) - stats.asleep;
+	*pStats = stats;
+}
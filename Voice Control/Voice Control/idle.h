@@ -0,0 +1,34 @@
+/*
+ * idle.h
+ *
+ * Idle policy for the main loop.  When there is nothing to do the CPU is
+ * put into AVR idle sleep, which stops the core clock but leaves every
+ * peripheral running, so any enabled interrupt wakes it: USART0 RX/UDRE,
+ * the Timer0 system tick (timer service and stepper clock, ~1 ms) and any
+ * pin-change interrupts a module has enabled.
+ */
+#ifndef IDLE_H_
+#define IDLE_H_
+
+#include <stdint.h>
+
+/* Time spent asleep and awake, in TICK_stamp() counts (12.8 us). */
+typedef struct IDLE_STATS_TYPE {
+
+	uint32_t asleep;
+	uint32_t awake;
+	uint32_t sleeps;		// Number of times the CPU went to sleep.
+
+} IDLE_STATS;
+
+/* Select idle sleep and start accounting.  Call once, after TICK_open(). */
+void IDLE_open( void );
+
+/* Sleep until the next interrupt, unless a received byte is already
+ * waiting.  The caller decides whether any other work is due. */
+void IDLE_sleep( void );
+
+/* Snapshot the accounting into '*pStats'; 'awake' is brought up to date. */
+void IDLE_get_stats( IDLE_STATS *pStats );
+
+#endif /* IDLE_H_ */
@@ -0,0 +1,112 @@
+/*
+ * kin.c
+ *
+ * Differential-drive kinematics in integer arithmetic.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include "motion.h"
+#include "units.h"
+#include "kin.h"
+
+#if STEPS_PER_RVLTN % 10
+	#error "STEPS_PER_RVLTN must be a multiple of 10"
+#endif
+
+/* 'v' scaled by 'num' / 'den', rounded, at least 1 unless 'v' or 'num'
+ * is 0. */
+static uint16_t scale( uint16_t v, uint16_t num, uint16_t den )
+{
+	uint32_t r;
+
+	if( v == 0 || num == 0 )
+		return 0;
+
+	r = ( (uint32_t) v * num + den / 2 ) / den;
+
+	return r ? (uint16_t) r : 1;
+}
+
+/* Fill 'pSeg' with 'left' and 'right' steps (negative: reverse), the
+ * faster wheel at 'speed' mm/s and 'accel' mm/s^2. */
+static uint8_t fill( MOTION_SEG *pSeg, int32_t left, int32_t right,
+	uint16_t speed, uint16_t accel )
+{
+	uint32_t nL = ( left < 0 ) ? -left : left;
+	uint32_t nR = ( right < 0 ) ? -right : right;
+	uint32_t nMax = ( nL > nR ) ? nL : nR;
+	uint32_t v = UNITS_MM_STEPS( speed );
+	uint32_t a = UNITS_MM_STEPS( accel );
+
+	if( nMax > 0xFFFF || v > MOTION_MAX_SPEED || a > MOTION_MAX_ACCEL )
+		return KIN_ERR_RANGE;
+
+	pSeg->left.flags = ( left < 0 ) ? MOTION_FLG_REV : 0;
+	pSeg->left.steps = nL;
+	pSeg->left.speed = scale( v, nL, nMax );
+	pSeg->left.accel = scale( a, nL, nMax );
+
+	pSeg->right.flags = ( right < 0 ) ? MOTION_FLG_REV : 0;
+	pSeg->right.steps = nR;
+	pSeg->right.speed = scale( v, nR, nMax );
+	pSeg->right.accel = scale( a, nR, nMax );
+
+	return KIN_OK;
+}
+
+uint8_t KIN_straight( MOTION_SEG *pSeg, int16_t mm, uint16_t speed, uint16_t accel )
+{
+	int32_t n = UNITS_MM_STEPS( ( mm < 0 ) ? -mm : mm );
+
+	if( mm < 0 )
+		n = -n;
+
+	return fill( pSeg, n, n, speed, accel );
+}
+
+uint8_t KIN_arc( MOTION_SEG *pSeg, uint16_t radius, int16_t deg, uint16_t speed,
+	uint16_t accel )
+{
+	uint16_t turn = ( deg < 0 ) ? -deg : deg;
+	int32_t inner, outer;
+
+	if( radius > KIN_MAX_RADIUS || turn > KIN_MAX_ANGLE )
+		return KIN_ERR_RANGE;
+
+	/* A wheel at radius r travels pi * r * turn / 180 and a step moves it
+	 * pi * D / STEPS_PER_RVLTN, so it takes turn * r * STEPS_PER_RVLTN /
+	 * ( 180 * D ) steps.  Radii are doubled to keep half the track whole. */
+	inner = 2L * radius * 10 - KIN_TRACK;
+	outer = 2L * radius * 10 + KIN_TRACK;
+
+	inner = ( inner * turn * ( STEPS_PER_RVLTN / 10 ) +
+		( ( inner < 0 ) ? -18L : 18L ) * UNITS_WHEEL_DIAM ) / ( 36L * UNITS_WHEEL_DIAM );
+	outer = ( outer * turn * ( STEPS_PER_RVLTN / 10 ) + 18L * UNITS_WHEEL_DIAM ) /
+		( 36L * UNITS_WHEEL_DIAM );
+
+	if( deg < 0 )
+		return fill( pSeg, outer, inner, speed, accel );
+
+	return fill( pSeg, inner, outer, speed, accel );
+}
+
+uint8_t KIN_pivot( MOTION_SEG *pSeg, int16_t deg, uint16_t speed, uint16_t accel )
+{
+	return KIN_arc( pSeg, 0, deg, speed, accel );
+}
+
+void KIN_move( const MOTION_SEG *pSeg )
+{
+	STEPPER_ID which = STEPPER_BOTH;
+
+	if( pSeg->left.steps == 0 )
+		which = STEPPER_RIGHT;
+	else if( pSeg->right.steps == 0 )
+		which = STEPPER_LEFT;
+
+	STEPPER_move_stnb( which,
+		( pSeg->left.flags & MOTION_FLG_REV ) ? STEPPER_REV : STEPPER_FWD,
+		pSeg->left.steps, pSeg->left.speed, pSeg->left.accel, STEPPER_BRK_OFF,
+		( pSeg->right.flags & MOTION_FLG_REV ) ? STEPPER_REV : STEPPER_FWD,
+		pSeg->right.steps, pSeg->right.speed, pSeg->right.accel, STEPPER_BRK_OFF );
+}
@@ -0,0 +1,59 @@
+/*
+ * kin.h
+ *
+ * Differential-drive kinematics.  Turns a move given in physical units
+ * (millimetres, degrees, mm/s) into the step counts, directions, speeds
+ * and accelerations of both wheels, as one MOTION_SEG.  The segment can be
+ * started on its own with KIN_move() or queued with MOTION_push(), where
+ * consecutive moves blend.
+ *
+ * Speeds and accelerations are those of the faster wheel; the slower one
+ * gets the same values scaled by its share of the steps, so both wheels
+ * start and finish together and the robot follows the arc.
+ *
+ * Everything is integer arithmetic.  Wheel travel is worked out as
+ * angle x radius / diameter, where pi cancels out, so arcs and pivots are
+ * exact to the rounding of one step; straight moves and speeds go through
+ * UNITS_MM_STEPS().
+ */
+#ifndef KIN_H_
+#define KIN_H_
+
+#include <stdint.h>
+#include "motion.h"
+#include "units.h"
+
+/* Track width (distance between the wheel contact points) in 0.1 mm; the
+ * wheel diameter is UNITS_WHEEL_DIAM.  The defaults match the old
+ * hard-coded turns (150 steps for a 90 degree pivot); measure the robot and
+ * override. */
+#ifndef KIN_TRACK
+	#define KIN_TRACK			2286
+#endif
+
+#define KIN_MAX_RADIUS		10000	// mm.
+#define KIN_MAX_ANGLE		360		// Degrees per segment.
+
+/* KIN_xxx() results. */
+#define KIN_OK				0
+#define KIN_ERR_RANGE		1	// Too far, too fast or too tight for one segment.
+
+/* Straight move of 'mm' (negative: backwards) at 'speed' mm/s, ramped at
+ * 'accel' mm/s^2 (0: no ramp). */
+uint8_t KIN_straight( MOTION_SEG *pSeg, int16_t mm, uint16_t speed, uint16_t accel );
+
+/* Forward arc through 'deg' degrees (positive: to the left) about a centre
+ * 'radius' mm from the middle of the axle.  A radius under half the track
+ * turns the inner wheel backwards; 0 pivots on the spot. */
+uint8_t KIN_arc( MOTION_SEG *pSeg, uint16_t radius, int16_t deg, uint16_t speed,
+	uint16_t accel );
+
+/* Pivot on the spot through 'deg' degrees (positive: to the left). */
+uint8_t KIN_pivot( MOTION_SEG *pSeg, int16_t deg, uint16_t speed, uint16_t accel );
+
+/* Start 'pSeg' right away with STEPPER_move() without blocking, brakes
+ * off.  Both wheels report through step_done; a wheel without steps is
+ * left out and its flag is not touched. */
+void KIN_move( const MOTION_SEG *pSeg );
+
+#endif /* KIN_H_ */
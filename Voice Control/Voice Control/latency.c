@@ -0,0 +1,145 @@
+/*
+ * latency.c
+ *
+ * STOP-to-standstill probe and per-opcode command latency histograms.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <util/atomic.h>
+#include "tick.h"
+#include "stepeng.h"
+#include "latency.h"
+
+static volatile uint8_t armed;
+static volatile uint32_t start;
+static volatile LATENCY_STOP stop_stats;
+
+static LATENCY_HIST hist[ LATENCY_ROWS ];
+static uint8_t curr_row;			// Row of the command being timed.
+static uint16_t parse_mark;
+
+static volatile uint8_t step_armed;
+static volatile uint8_t step_row;
+static volatile uint16_t dispatch_mark;
+
+/* Add 'counts' to the histogram of 'stage' in 'row'. */
+static void LATENCY_record( uint8_t row, uint8_t stage, uint16_t counts )
+{
+	uint8_t b = 0;
+
+	while( ( counts >= 4 ) && ( b < LATENCY_BUCKETS - 1 ) )
+	{
+		counts >>= 2;
+		b++;
+	}
+
+	if( hist[ row ][ stage ][ b ] != 0xFF )
+		hist[ row ][ stage ][ b ]++;
+}
+
+/* Tick hook: close the STOP measurement once both wheels have stopped and
+ * the first-step measurement once the engine has stamped a step. */
+static void LATENCY_tick( void )
+{
+	uint32_t elapsed;
+	uint16_t mark;
+
+	if( step_armed )
+	{
+		if( STEPENG_step_seen( &mark ) )
+		{
+			LATENCY_record( step_row, LATENCY_STEP,
+									TICK_mark_diff( mark, dispatch_mark ) );
+			step_armed = 0;
+		}
+		else if( TICK_mark_diff( TICK_mark(), dispatch_mark ) >
+				 250U * ( OCR0A + 1 ) )
+		{
+			STEPENG_watch_step( 0 );	// Out of TICK_mark() range: give up.
+			step_armed = 0;
+		}
+	}
+
+	if( !armed )
+		return;
+
+	if( STEPPER_params.curr_speed.left != 0 ||
+		STEPPER_params.curr_speed.right != 0 )
+		return;
+
+	elapsed = TICK_stamp() - start;
+	armed = 0;
+
+	stop_stats.last = elapsed;
+	if( elapsed > stop_stats.max )
+		stop_stats.max = elapsed;
+	stop_stats.count++;
+}
+
+uint8_t LATENCY_open( void )
+{
+	return TICK_attach( LATENCY_tick );
+}
+
+void LATENCY_stop_begin( uint16_t rx_mark )
+{
+	/* Back from now to the RX interrupt, reading both clocks at once. */
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		start = TICK_stamp() - TICK_mark_diff( TICK_mark(), rx_mark );
+		armed = 1;
+	}
+}
+
+void LATENCY_stop_cancel( void )
+{
+	armed = 0;
+}
+
+void LATENCY_get_stop( LATENCY_STOP *pStop )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		*pStop = stop_stats;
+	}
+}
+
+void LATENCY_begin( uint8_t op, uint16_t rx_mark )
+{
+	parse_mark = TICK_mark_now();
+	curr_row = ( op < LATENCY_ROW_OTHER ) ? op : LATENCY_ROW_OTHER;
+
+	LATENCY_record( curr_row, LATENCY_PARSE,
+									TICK_mark_diff( parse_mark, rx_mark ) );
+}
+
+void LATENCY_dispatch( uint8_t moving )
+{
+	uint16_t now = TICK_mark_now();
+
+	LATENCY_record( curr_row, LATENCY_DISPATCH,
+									TICK_mark_diff( now, parse_mark ) );
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		step_armed = moving;
+		step_row = curr_row;
+		dispatch_mark = now;
+		STEPENG_watch_step( moving );
+	}
+}
+
+void LATENCY_get_hist( uint8_t row, LATENCY_HIST *pHist )
+{
+	uint8_t s, b;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		for( s = 0; s < LATENCY_STAGES; s++ )
+			for( b = 0; b < LATENCY_BUCKETS; b++ )
+			{
+				( *pHist )[ s ][ b ] = hist[ row ][ s ][ b ];
+				hist[ row ][ s ][ b ] = 0;
+			}
+	}
+}
@@ -0,0 +1,83 @@
+/*
+ * latency.h
+ *
+ * On-target latency measurements.  Times are in TICK_stamp() counts
+ * (12.8 us).
+ *
+ * STOP latency: from the RX interrupt of a STOP frame's last byte to both
+ * wheels standing still, so the time the frame waited in the receive ring
+ * and in the parser counts too.  The end point is sampled on the system
+ * tick, right after the stepper clock, so it is accurate to one tick.
+ *
+ * Command latency: every command is timed through three stages, each
+ * bounded by a timestamp:
+ *
+ *     RX ISR --(LATENCY_PARSE)--> parse complete --(LATENCY_DISPATCH)-->
+ *     dispatch --(LATENCY_STEP)--> first step of either wheel
+ *
+ * "RX ISR" is the arrival of the frame's last byte and "dispatch" the
+ * point where the command's stepper calls have been issued (or its segments
+ * queued).  The first step is stamped by the stepper engine as it is taken
+ * (STEPENG_watch_step()), in the compare interrupt on the Timer1 engine,
+ * so this stage too is timed below a tick; it is only timed for commands
+ * that set wheels moving.  Each stage feeds a log4-bucketed histogram per
+ * opcode, kept in RAM and read back with PROTO_OP_GET_LATENCY_HIST.
+ */
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+
+/* Command stages. */
+#define LATENCY_PARSE		0
+#define LATENCY_DISPATCH	1
+#define LATENCY_STEP		2
+#define LATENCY_STAGES		3
+
+/* Histogram rows: one per motion opcode (PROTO_OP_STOP..PROTO_OP_MOVE) plus
+ * one shared by all other opcodes. */
+#define LATENCY_ROWS		8
+#define LATENCY_ROW_OTHER	( LATENCY_ROWS - 1 )
+
+/* Bucket b counts samples below 4^(b+1) counts, i.e. < 51 us, < 205 us,
+ * < 819 us, < 3.3 ms, < 13 ms, < 52 ms, < 210 ms; the last bucket takes
+ * everything longer.  Counts saturate at 255. */
+#define LATENCY_BUCKETS		8
+
+typedef uint8_t LATENCY_HIST[ LATENCY_STAGES ][ LATENCY_BUCKETS ];
+
+typedef struct LATENCY_STOP_TYPE {
+
+	uint32_t last;			// Most recent STOP-to-standstill time.
+	uint32_t max;			// Worst case seen.
+	uint16_t count;			// Completed measurements.
+
+} LATENCY_STOP;
+
+/* Attach the standstill probe to the system tick.  Call once, after
+ * TICK_open().  Returns 0 if no tick hook slot was free. */
+uint8_t LATENCY_open( void );
+
+/* A STOP command was just decoded: start timing from 'rx_mark', the
+ * frame's PROTO_FRAME.rx_mark, which must be under 256 ticks old. */
+void LATENCY_stop_begin( uint16_t rx_mark );
+
+/* Another motion command superseded the STOP: drop the measurement. */
+void LATENCY_stop_cancel( void );
+
+/* Snapshot the STOP latency figures into '*pStop'. */
+void LATENCY_get_stop( LATENCY_STOP *pStop );
+
+/* Command 'op' has just been parsed; 'rx_mark' is the frame's
+ * PROTO_FRAME.rx_mark.  Records the parse stage. */
+void LATENCY_begin( uint8_t op, uint16_t rx_mark );
+
+/* The command passed to LATENCY_begin() has been dispatched.  Records the
+ * dispatch stage and, if 'moving' is non-zero, starts waiting for the first
+ * step. */
+void LATENCY_dispatch( uint8_t moving );
+
+/* Copy the histograms of 'row' into '*pHist' and clear them. */
+void LATENCY_get_hist( uint8_t row, LATENCY_HIST *pHist );
+
+#endif /* LATENCY_H_ */
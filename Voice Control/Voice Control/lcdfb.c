@@ -0,0 +1,301 @@
+/*
+ * lcdfb.c
+ *
+ * LCD shadow framebuffer with per-page dirty spans, flushed in the
+ * background by the SPI transfer complete interrupt.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "lcdfb.h"
+
+/* Layout of 'char_bitmap': a 3-byte header, then LCD_FONTPIXWIDTH column
+ * bytes per glyph starting at ' ', each written to the LCD as-is. */
+#define FONT_HDR		3
+#define FONT_FIRST		' '
+#define FONT_LAST		0x89	// BATT_NEEDCHG
+
+/* printf() starts on the highest page and works down. */
+#define ROW_PAGE( row )	( LCD_nPAGES - 1 - ( row ) )
+
+static uint8_t fb[ LCD_nPAGES ][ LCD_PIX_WIDTH ];
+
+/* Columns lo..hi of each page differ from the LCD; clean when lo > hi. */
+static uint8_t dirty_lo[ LCD_nPAGES ];
+static uint8_t dirty_hi[ LCD_nPAGES ];
+
+/* Flush queue: the dirty spans taken by LCDFB_flush(), sent one byte per
+ * interrupt.  Each span is its three addressing commands followed by the
+ * data bytes for columns lo..hi, read from 'fb' as they go out. */
+typedef struct SPAN_TYPE {
+
+	uint8_t page;
+	uint8_t lo;
+	uint8_t hi;
+
+} SPAN;
+
+static SPAN spans[ LCD_nPAGES ];
+static uint8_t n_spans;
+static uint8_t cur;					// Span being sent (ISR).
+static uint8_t pos;					// Byte within it; 0..2 are commands.
+static volatile uint8_t busy;		// Flush in progress; the ISR owns the bus.
+static uint8_t held;				// Bus taken by LCDFB_acquire().
+
+/* A0 for the ISR.  A constant one-bit update of PORTB compiles to a single
+ * cbi/sbi; main-loop bus users cannot interleave with it since they hold
+ * the bus (see lcdfb.h). */
+#define A0_COMMAND()	( PORTB &= ~( 1 << PB3 ) )
+#define A0_DATA()		( PORTB |= ( 1 << PB3 ) )
+
+/* Store 'data' at 'page', 'x' and widen the dirty span if it changed. */
+static void set_byte( uint8_t page, uint8_t x, uint8_t data )
+{
+	if( fb[ page ][ x ] == data )
+		return;
+
+	fb[ page ][ x ] = data;
+
+	if( dirty_lo[ page ] > dirty_hi[ page ] )
+	{
+		dirty_lo[ page ] = x;
+		dirty_hi[ page ] = x;
+	}
+	else if( x < dirty_lo[ page ] )
+		dirty_lo[ page ] = x;
+	else if( x > dirty_hi[ page ] )
+		dirty_hi[ page ] = x;
+}
+
+void LCDFB_open( void )
+{
+	uint8_t page;
+	uint8_t x;
+
+	/* Whatever the LCD shows now is unknown: zero the copy and send it all. */
+	for( page = 0; page < LCD_nPAGES; page++ )
+	{
+		for( x = 0; x < LCD_PIX_WIDTH; x++ )
+			fb[ page ][ x ] = 0;
+
+		dirty_lo[ page ] = 0;
+		dirty_hi[ page ] = LCD_PIX_WIDTH - 1;
+	}
+}
+
+void LCDFB_clear( void )
+{
+	uint8_t row;
+
+	for( row = 0; row < LCDFB_ROWS; row++ )
+		LCDFB_clear_row( row );
+}
+
+void LCDFB_clear_row( uint8_t row )
+{
+	uint8_t x;
+
+	if( row >= LCDFB_ROWS )
+		return;
+
+	for( x = 0; x < LCD_PIX_WIDTH; x++ )
+		set_byte( ROW_PAGE( row ), x, 0 );
+}
+
+void LCDFB_putc( uint8_t row, uint8_t col, char c )
+{
+	const char *pGlyph;
+	uint8_t page = ROW_PAGE( row );
+	uint8_t x = col * LCDFB_CELL;
+	uint8_t i;
+
+	if( row >= LCDFB_ROWS || col >= LCD_nCOLS )
+		return;
+
+	if( (uint8_t) c < FONT_FIRST || (uint8_t) c > FONT_LAST )
+		c = '?';
+
+	pGlyph = &char_bitmap[ FONT_HDR +
+		( (uint8_t) c - FONT_FIRST ) * LCD_FONTPIXWIDTH ];
+
+	for( i = 0; i < LCD_FONTPIXWIDTH; i++ )
+		set_byte( page, x + i, pgm_read_byte( &pGlyph[ i ] ) );
+
+	set_byte( page, x + LCD_FONTPIXWIDTH, 0 );	// Gap to the next cell.
+}
+
+uint8_t LCDFB_puts( uint8_t row, uint8_t col, const char *pStr )
+{
+	while( *pStr && col < LCD_nCOLS )
+		LCDFB_putc( row, col++, *pStr++ );
+
+	return col;
+}
+
+uint8_t LCDFB_puts_P( uint8_t row, uint8_t col, const char *pStr )
+{
+	char c;
+
+	while( ( c = pgm_read_byte( pStr++ ) ) != 0 && col < LCD_nCOLS )
+		LCDFB_putc( row, col++, c );
+
+	return col;
+}
+
+void LCDFB_print_row( uint8_t row, const char *pStr )
+{
+	uint8_t col = LCDFB_puts( row, 0, pStr );
+
+	while( col < LCD_nCOLS )
+		LCDFB_putc( row, col++, ' ' );
+}
+
+void LCDFB_show( const LCDFB_SCREEN *pScreen )
+{
+	uint8_t row;
+
+	for( row = 0; row < LCDFB_ROWS; row++ )
+		LCDFB_show_row( row, &pScreen->rows[ row ], LCD_nCOLS );
+}
+
+void LCDFB_show_row( uint8_t row, const LCDFB_ROW *pRow, uint8_t cols )
+{
+	const uint8_t *pBits;
+	uint8_t width;
+	uint8_t end;
+	uint8_t x;
+
+	if( row >= LCDFB_ROWS )
+		return;
+
+	pBits = (const uint8_t *) pgm_read_word( &pRow->pBits );
+	width = pgm_read_byte( &pRow->width );
+
+	/* The last cell runs to the right edge (128 = 21 cells + 2 pixels). */
+	end = ( cols >= LCD_nCOLS ) ? LCD_PIX_WIDTH : cols * LCDFB_CELL;
+
+	for( x = 0; x < end; x++ )
+		set_byte( ROW_PAGE( row ), x,
+			( x < width ) ? pgm_read_byte( &pBits[ x ] ) : 0 );
+}
+
+/* Start the next byte of the queue, or release the bus when it is empty.
+ * Called with interrupts disabled. */
+static void send_next( void )
+{
+	SPAN *pSpan = &spans[ cur ];
+	uint8_t data;
+
+	if( cur == n_spans )
+	{
+		SPCR &= ~( 1 << SPIE );
+		busy = 0;
+		return;
+	}
+
+	switch( pos )
+	{
+		case 0:
+			A0_COMMAND();
+			data = LCDCMD_SET_PG_ADDR | pSpan->page;
+			break;
+		case 1:
+			data = LCDCMD_COL_ADDR_H | LCD_HI_NIBBLE( pSpan->lo );
+			break;
+		case 2:
+			data = LCDCMD_COL_ADDR_L | LCD_LO_NIBBLE( pSpan->lo );
+			break;
+		default:
+			if( pos == 3 )
+				A0_DATA();
+			data = fb[ pSpan->page ][ pSpan->lo + pos - 3 ];
+			break;
+	}
+
+	if( pos >= 3 && pSpan->lo + pos - 3 == pSpan->hi )
+	{
+		cur++;
+		pos = 0;
+	}
+	else
+		pos++;
+
+	SPDR = data;
+}
+
+ISR(SPI_STC_vect)
+{
+	send_next();
+}
+
+uint16_t LCDFB_flush( void )
+{
+	uint16_t queued = 0;
+	uint8_t page;
+	uint8_t n = 0;
+
+	if( busy || held )
+		return 0;	// Changes stay dirty for the next call.
+
+	/* Take the dirty spans.  Bytes drawn from here on mark their page dirty
+	 * again, so a change racing the transfer is sent by the next flush. */
+	for( page = 0; page < LCD_nPAGES; page++ )
+	{
+		if( dirty_lo[ page ] > dirty_hi[ page ] )
+			continue;
+
+		spans[ n ].page = page;
+		spans[ n ].lo = dirty_lo[ page ];
+		spans[ n ].hi = dirty_hi[ page ];
+		queued += 3 + dirty_hi[ page ] - dirty_lo[ page ] + 1;
+		n++;
+
+		dirty_lo[ page ] = 0xFF;
+		dirty_hi[ page ] = 0;
+	}
+
+	if( n == 0 )
+		return 0;
+
+	/* Select the LCD the API's way, so its SPI settings are loaded and the
+	 * API knows which slave is addressed. */
+	SPI_set_slave_addr( SPI_ADDR_LCD );
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		n_spans = n;
+		cur = 0;
+		pos = 0;
+		busy = 1;
+
+		/* SPI_transmit() polls SPIF but leaves it set; clear it (read SPSR,
+		 * then SPDR) or the interrupt would fire for a stale transfer. */
+		(void) SPSR;
+		(void) SPDR;
+		SPCR |= ( 1 << SPIE );
+
+		send_next();
+	}
+
+	return queued;
+}
+
+uint8_t LCDFB_done( void )
+{
+	return !busy;
+}
+
+void LCDFB_acquire( void )
+{
+	while( busy )
+		;
+
+	held = 1;
+}
+
+void LCDFB_release( void )
+{
+	held = 0;
+}
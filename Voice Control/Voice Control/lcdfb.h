@@ -0,0 +1,101 @@
+/*
+ * lcdfb.h
+ *
+ * Shadow framebuffer for the 128x32 LCD.  Drawing functions only change
+ * the copy in RAM and record, per page, the span of columns whose bytes
+ * actually changed; LCDFB_flush() then sends just those spans over SPI.
+ * Redrawing a status line with mostly the same text therefore costs a few
+ * SPI bytes instead of an LCD_clear() and a full printf().
+ *
+ * The flush does not wait for the SPI: it queues the spans and returns, and
+ * the SPI transfer complete interrupt sends them one byte at a time.  The
+ * framebuffer may be drawn into meanwhile.  While a flush is running the
+ * interrupt owns the bus and the LCD's A0 line (PB3), so any other SPI
+ * traffic from the main loop (the ATtiny, the PSX controller, or the API's
+ * own LCD_xxx() functions) must take the bus with LCDFB_acquire() and hand
+ * it back with LCDFB_release().  Their read-modify-writes of PORTB (slave
+ * select, A0) then cannot undo a change the interrupt made meanwhile.  Any
+ * other main-loop change to PORTB must be a single sbi/cbi (a constant
+ * one-bit set or clear) or be made with interrupts disabled.  Nothing
+ * touches the SPI from an interrupt.
+ *
+ * Text uses the API's 5x7 font in 6-pixel cells, so the screen holds
+ * LCDFB_ROWS rows of LCD_nCOLS characters.  Rows are numbered from the top,
+ * in the order printf() fills them.
+ *
+ * Once the framebuffer is in use, draw through it only: output from
+ * printf()/LCD_printf() is not seen by the shadow copy and would be
+ * overwritten piecemeal.
+ */
+#ifndef LCDFB_H_
+#define LCDFB_H_
+
+#include <stdint.h>
+
+#define LCDFB_ROWS		4		// Text rows (one per LCD page).
+#define LCDFB_CELL		6		// Character cell width in pixels.
+
+/* A screen pre-rendered into program memory by tools/mkscreens.py (see
+ * screens.txt): the page bytes of each text row, NULL for a blank row. */
+typedef struct LCDFB_ROW_TYPE {
+
+	const uint8_t *pBits;
+	uint8_t width;			// Bytes in 'pBits'; the rest of the row is blank.
+
+} LCDFB_ROW;
+
+typedef struct LCDFB_SCREEN_TYPE {
+
+	LCDFB_ROW rows[ LCDFB_ROWS ];
+
+} LCDFB_SCREEN;
+
+/* Clear the shadow copy and mark the whole screen for the next flush.  Call
+ * once, after LCD_open(). */
+void LCDFB_open( void );
+
+/* Blank the whole screen / one text row. */
+void LCDFB_clear( void );
+void LCDFB_clear_row( uint8_t row );
+
+/* Draw character 'c' at text position 'row', 'col'.  Positions off the
+ * screen are ignored. */
+void LCDFB_putc( uint8_t row, uint8_t col, char c );
+
+/* Draw 'pStr' from 'row', 'col', clipped at the end of the row.  Returns
+ * the column after the last character. */
+uint8_t LCDFB_puts( uint8_t row, uint8_t col, const char *pStr );
+
+/* LCDFB_puts() for a string in program memory. */
+uint8_t LCDFB_puts_P( uint8_t row, uint8_t col, const char *pStr );
+
+/* Draw 'pStr' on 'row' and blank the rest of it. */
+void LCDFB_print_row( uint8_t row, const char *pStr );
+
+/* Replace the whole screen with 'pScreen', which is in program memory.  A
+ * straight copy: no formatting or glyph lookup. */
+void LCDFB_show( const LCDFB_SCREEN *pScreen );
+
+/* Draw the pre-rendered row 'pRow' (in program memory) on 'row', blanking
+ * up to 'cols' character cells; cells from 'cols' on are left alone. */
+void LCDFB_show_row( uint8_t row, const LCDFB_ROW *pRow, uint8_t cols );
+
+/* Queue the changed spans for the LCD and start sending them.  Returns the
+ * number of bytes queued (data plus addressing commands); 0 if nothing had
+ * changed, the previous flush is still running or the bus is held by
+ * LCDFB_acquire(), in which case the changes stay pending.  Safe to call
+ * on every pass of the main loop. */
+uint16_t LCDFB_flush( void );
+
+/* 1 once the last flush has been sent completely. */
+uint8_t LCDFB_done( void );
+
+/* Wait for the flush in progress and keep the SPI bus until
+ * LCDFB_release(); flushes meanwhile leave their changes pending.  Call
+ * from the main loop before any other use of the bus. */
+void LCDFB_acquire( void );
+
+/* Hand the bus back for flushing. */
+void LCDFB_release( void );
+
+#endif /* LCDFB_H_ */
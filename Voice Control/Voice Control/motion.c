@@ -0,0 +1,525 @@
+/*
+ * motion.c
+ *
+ * Decoding of PROTO_OP_MOVE segments and the tick-driven segment queue.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <util/atomic.h>
+#include "tick.h"
+#include "stepeng.h"
+#include "motion.h"
+
+/* Segment queue.  The main loop is the only writer of 'q_head' and the tick
+ * the only writer of 'q_tail', as with the USART rings. */
+static MOTION_SEG queue[ MOTION_QUEUE_SIZE ];
+static volatile uint8_t q_head;
+static volatile uint8_t q_tail;
+
+static volatile uint8_t enabled;	// Tick may load segments.
+static volatile uint8_t busy;		// A segment is in progress.
+static volatile uint8_t cut;		// MOTION_next(): end it early.
+static MOTION_SEG active;			// The segment in progress (tick only).
+static uint8_t active_run;			// 'active' is free-running (tick only).
+
+/* Speeds in the profiles are kept in 1/1024 steps/s, so that one tick's
+ * change of speed at an acceleration of A steps/s^2 is about A units. */
+#define VEL_SHIFT		10
+
+/* Acceleration change per tick, in speed units per tick. */
+#define JERK_STEP		( ( MOTION_JERK * 1024UL + 500000UL ) / 1000000UL )
+
+#if JERK_STEP < 1
+	#error "MOTION_JERK too low for the tick rate"
+#endif
+
+/* S-curve profile of one wheel (tick only). */
+typedef struct PROFILE_TYPE {
+
+	int32_t  vel;			// Current speed.
+	int16_t  acc;			// Current acceleration, speed units per tick.
+	uint16_t amax;			// Acceleration limit, same units; 0: no ramping.
+	uint16_t ramp;			// Ticks to ramp acceleration from 0 to 'amax'.
+	uint16_t exit;			// Junction speed braking is aimed at, steps/s.
+	uint8_t  braking;		// Slowing to 'exit' for the end of the segment.
+	uint16_t cmd;			// Speed last given to the library, steps/s.
+
+} PROFILE;
+
+static PROFILE prof_L, prof_R;
+
+static volatile MOTION_STATS stats;
+
+static uint16_t get_u16( const uint8_t *p )
+{
+	return p[ 0 ] | ( (uint16_t) p[ 1 ] << 8 );
+}
+
+/* Integer square root. */
+static uint16_t isqrt( uint32_t x )
+{
+	uint32_t bit = 1UL << 30;
+	uint32_t root = 0;
+
+	while( bit > x )
+		bit >>= 2;
+
+	while( bit )
+	{
+		if( x >= root + bit )
+		{
+			x -= root + bit;
+			root = ( root >> 1 ) + bit;
+		}
+		else
+			root >>= 1;
+
+		bit >>= 2;
+	}
+
+	return (uint16_t) root;
+}
+
+/* Highest speed the wheel may carry into its segment and still be able to
+ * stop by its end: v^2 / 2A is the distance to stop from v, halved here to
+ * leave room for the jerk-limited ends of the curve. */
+static uint16_t entry_speed( const MOTION_WHEEL *pWheel )
+{
+	uint16_t v;
+
+	if( pWheel->steps == 0 || pWheel->accel == 0 )
+		return pWheel->speed;
+
+	v = isqrt( (uint32_t) pWheel->steps * pWheel->accel );
+
+	return ( v < pWheel->speed ) ? v : pWheel->speed;
+}
+
+/* Decode one wheel. */
+static void decode_wheel( MOTION_WHEEL *pWheel, const uint8_t *p )
+{
+	pWheel->flags = p[ 0 ];
+	pWheel->steps = get_u16( &p[ 1 ] );
+	pWheel->speed = get_u16( &p[ 3 ] );
+	pWheel->accel = get_u16( &p[ 5 ] );
+}
+
+/* Returns 1 if the values of one wheel are in range. */
+static uint8_t wheel_ok( const MOTION_WHEEL *pWheel )
+{
+	return ( pWheel->flags & ~( MOTION_FLG_REV | MOTION_FLG_BRAKE ) ) == 0 &&
+		   pWheel->speed <= MOTION_MAX_SPEED &&
+		   pWheel->accel <= MOTION_MAX_ACCEL;
+}
+
+static uint8_t is_run_seg( const MOTION_SEG *pSeg )
+{
+	return pSeg->left.steps == 0 && pSeg->right.steps == 0 &&
+		   ( pSeg->left.speed != 0 || pSeg->right.speed != 0 );
+}
+
+/* Start one wheel of a segment at 'speed'. */
+static void move_wheel( STEPPER_ID w, const MOTION_WHEEL *pWheel, uint16_t speed )
+{
+	STEPENG_tick_move( w,
+		( pWheel->flags & MOTION_FLG_REV ) ? STEPPER_REV : STEPPER_FWD,
+		pWheel->steps, speed,
+		( pWheel->flags & MOTION_FLG_BRAKE ) ? STEPPER_BRK_ON : STEPPER_BRK_OFF );
+}
+
+/* Start 'pSeg' at the profiles' starting speeds and without the library's
+ * ramps, which the tick replaces.  A wheel without steps sits out a step
+ * segment. */
+static void move_seg( const MOTION_SEG *pSeg )
+{
+	uint8_t run = is_run_seg( pSeg );
+
+	if( run || pSeg->left.steps )
+		move_wheel( STEPPER_LEFT, &pSeg->left, prof_L.cmd );
+	if( run || pSeg->right.steps )
+		move_wheel( STEPPER_RIGHT, &pSeg->right, prof_R.cmd );
+}
+
+/* Speed at which the left or 'right' wheel may pass from the active segment
+ * into 'pNext' (NULL if nothing is queued yet), in steps/s.  0 unless it
+ * keeps turning the same way. */
+static uint16_t junction( uint8_t right, const MOTION_SEG *pNext )
+{
+	const MOTION_WHEEL *pCur = right ? &active.right : &active.left;
+	const MOTION_WHEEL *pNextWheel;
+
+	if( pNext == NULL )
+		return 0;
+
+	pNextWheel = right ? &pNext->right : &pNext->left;
+
+	if( ( pCur->flags & MOTION_FLG_BRAKE ) ||
+		( ( pCur->flags ^ pNextWheel->flags ) & MOTION_FLG_REV ) )
+		return 0;
+
+	if( pNextWheel->steps == 0 && !is_run_seg( pNext ) )
+		return 0;		// Not moving in the next segment.
+
+	return ( pCur->speed < pNextWheel->entry ) ? pCur->speed : pNextWheel->entry;
+}
+
+/* Set up 'pProf' for 'pWheel'.  With 'carry' the wheel keeps its speed and
+ * acceleration from the segment before; otherwise it starts at rest. */
+static void profile_start( PROFILE *pProf, const MOTION_WHEEL *pWheel, uint8_t carry )
+{
+	/* 1 steps/s^2 is 1.024 speed units per tick. */
+	pProf->amax = pWheel->accel + ( ( pWheel->accel * 3 ) >> 7 );
+	pProf->ramp = pProf->amax / JERK_STEP;
+	pProf->exit = 0;
+	pProf->braking = 0;
+
+	if( !carry )
+	{
+		pProf->vel = 0;
+		pProf->acc = 0;
+	}
+	else if( pProf->acc > (int16_t) pProf->amax )
+		pProf->acc = pProf->amax;
+	else if( pProf->acc < -(int16_t) pProf->amax )
+		pProf->acc = -(int16_t) pProf->amax;
+
+	pProf->cmd = pProf->vel >> VEL_SHIFT;
+	if( pWheel->steps && pProf->cmd < MOTION_MIN_SPEED )
+		pProf->cmd = MOTION_MIN_SPEED;
+}
+
+/* Move the speed of 'pProf' one tick towards 'target' (steps/s), changing
+ * acceleration by no more than JERK_STEP a tick.  The acceleration is eased
+ * off early enough to arrive at the target without overshooting. */
+static void profile_track( PROFILE *pProf, uint16_t target )
+{
+	int32_t goal = (int32_t) target << VEL_SHIFT;
+	int32_t err = goal - pProf->vel;
+	int16_t acc = pProf->acc;
+	uint32_t ease;
+
+	if( pProf->amax == 0 )
+	{
+		pProf->vel = goal;
+		pProf->acc = 0;
+		return;
+	}
+
+	if( err < 0 )
+	{
+		err = -err;
+		acc = -acc;		// Work on the mirror image.
+	}
+
+	if( err == 0 )
+		acc = 0;
+	else
+	{
+		/* Speed still gained while ramping 'acc' down to zero. */
+		ease = ( acc > 0 ) ? (uint32_t) acc * ( acc + JERK_STEP ) : 0;
+
+		if( ease >= 2UL * JERK_STEP * (uint32_t) err )
+			acc = ( acc > (int16_t) JERK_STEP ) ? acc - (int16_t) JERK_STEP : 1;
+		else if( acc + (int16_t) JERK_STEP < (int16_t) pProf->amax )
+			acc += (int16_t) JERK_STEP;
+		else
+			acc = pProf->amax;
+	}
+
+	if( goal < pProf->vel )
+		acc = -acc;
+
+	pProf->acc = acc;
+	pProf->vel += acc;
+
+	/* Landed on or past the target. */
+	if( ( err != 0 ) && ( ( acc > 0 ) == ( pProf->vel >= goal ) ) )
+	{
+		pProf->vel = goal;
+		pProf->acc = 0;
+	}
+}
+
+/* Decide whether a wheel with 'left' steps to go must start slowing to
+ * 'exit' now.  Stopping from speed v to e takes (v - e) / amax ticks plus
+ * 'ramp' for the rounded ends of the curve, and the distance covered
+ * meanwhile is the average speed times that time; this overestimates the
+ * distance of a short curve, so the wheel arrives early rather than late. */
+static uint8_t profile_must_brake( const PROFILE *pProf, uint16_t left )
+{
+	int32_t exit = (int32_t) pProf->exit << VEL_SHIFT;
+	uint32_t ticks;
+	uint32_t avg;
+
+	if( pProf->vel <= exit )
+		return 0;
+
+	if( pProf->amax == 0 )
+		return left <= 1;
+
+	ticks = (uint32_t)( pProf->vel - exit ) / pProf->amax + pProf->ramp;
+	avg = ( ( pProf->vel + exit ) >> ( VEL_SHIFT + 1 ) ) + 1;	// steps/s
+
+	return (uint32_t) left * 1000 <= avg * ticks;
+}
+
+/* Advance one wheel of the active segment by a tick and give the engine
+ * its new speed.  'left' is the wheel's remaining steps in a step segment;
+ * 'exit' the junction speed into what is queued next. */
+static void profile_tick( PROFILE *pProf, STEPPER_ID which,
+	const MOTION_WHEEL *pWheel, uint16_t left, uint16_t exit )
+{
+	uint16_t target = pWheel->speed;
+	uint16_t cmd;
+
+	if( active_run )
+	{
+		if( exit < target && q_head != q_tail )
+			target = exit;		// Hand over at the junction speed.
+	}
+	else
+	{
+		if( exit != pProf->exit )
+		{
+			pProf->exit = exit;		// Something new was queued.
+			pProf->braking = 0;
+		}
+
+		if( !pProf->braking )
+			pProf->braking = profile_must_brake( pProf, left );
+
+		if( pProf->braking )
+			target = exit;
+	}
+
+	profile_track( pProf, target );
+
+	cmd = pProf->vel >> VEL_SHIFT;
+	if( !active_run && cmd < MOTION_MIN_SPEED )
+		cmd = MOTION_MIN_SPEED;
+
+	if( cmd != pProf->cmd )
+	{
+		pProf->cmd = cmd;
+		STEPENG_tick_speed( which, cmd );
+	}
+}
+
+/* Has the segment in progress finished on every wheel it moves?  A step
+ * segment is done once the library reports its steps done; a free-running
+ * one once a segment is queued behind it and both wheels have reached the
+ * junction speed.  MOTION_next() ends either as soon as a segment is
+ * queued. */
+static uint8_t active_done( const MOTION_SEG *pNext )
+{
+	if( cut && pNext != NULL )
+		return 1;
+
+	if( active_run )
+		return pNext != NULL &&
+			( prof_L.vel >> VEL_SHIFT ) <= junction( 0, pNext ) &&
+			( prof_R.vel >> VEL_SHIFT ) <= junction( 1, pNext );
+
+	if( active.left.steps != 0 && !step_done.left )
+		return 0;
+	if( active.right.steps != 0 && !step_done.right )
+		return 0;
+
+	return 1;
+}
+
+/* Tick hook: run the profiles of the segment in progress, retire it once it
+ * is done and start the next one in the same tick, carrying the wheel
+ * speeds across the junction. */
+static void MOTION_tick( void )
+{
+	uint8_t tail = q_tail;
+	const MOTION_SEG *pNext;
+	STEPPER_STEPS left;
+	uint8_t chained = 0;
+	uint8_t carry_L, carry_R;
+
+	/* The engine calls below would race a STEPPER_xxx() call the tick has
+	 * interrupted; try again next tick. */
+	if( !enabled || STEPPER_params.busy_status == STEPPER_BUSY )
+		return;
+
+	pNext = ( q_head != tail ) ? &queue[ tail & MOTION_QUEUE_MASK ] : NULL;
+
+	if( busy )
+	{
+		if( !active_done( pNext ) )
+		{
+			left = STEPPER_get_nSteps();
+
+			if( active.left.speed )
+				profile_tick( &prof_L, STEPPER_LEFT, &active.left, left.left,
+					junction( 0, pNext ) );
+			if( active.right.speed )
+				profile_tick( &prof_R, STEPPER_RIGHT, &active.right, left.right,
+					junction( 1, pNext ) );
+			return;
+		}
+
+		busy = 0;
+		chained = 1;
+		if( !active_run && ( q_head == tail ) )
+			stats.underruns++;
+	}
+
+	/* Skip segments with nothing to move. */
+	while( q_head != tail )
+	{
+		pNext = &queue[ tail & MOTION_QUEUE_MASK ];
+		q_tail = ++tail;
+
+		if( pNext->left.steps || pNext->right.steps ||
+			pNext->left.speed || pNext->right.speed )
+		{
+			/* Wheels that pass the junction at speed keep their state. */
+			carry_L = chained && active.left.speed && pNext->left.speed &&
+				junction( 0, pNext );
+			carry_R = chained && active.right.speed && pNext->right.speed &&
+				junction( 1, pNext );
+
+			active = *pNext;
+			active_run = is_run_seg( &active );
+			profile_start( &prof_L, &active.left, carry_L );
+			profile_start( &prof_R, &active.right, carry_R );
+
+			cut = 0;
+			step_done.left = 0;
+			step_done.right = 0;
+			move_seg( &active );
+
+			busy = 1;
+			stats.segments++;
+			break;
+		}
+	}
+}
+
+uint8_t MOTION_open( void )
+{
+	return TICK_attach( MOTION_tick );
+}
+
+/* Check 'n' segments against the rules of one frame.  Returns 1 if they
+ * may be queued. */
+static uint8_t segs_ok( const MOTION_SEG *pSegs, uint8_t n )
+{
+	uint8_t i;
+
+	for( i = 0; i < n; i++ )
+	{
+		const MOTION_SEG *pSeg = &pSegs[ i ];
+
+		if( !wheel_ok( &pSeg->left ) || !wheel_ok( &pSeg->right ) )
+			return 0;
+
+		/* Within a frame only the last segment may run freely. */
+		if( is_run_seg( pSeg ) && ( i != n - 1 ) )
+			return 0;
+
+		/* In a step segment a wheel without steps must also stand still. */
+		if( !is_run_seg( pSeg ) &&
+			( ( pSeg->left.steps == 0 && pSeg->left.speed != 0 ) ||
+			  ( pSeg->right.steps == 0 && pSeg->right.speed != 0 ) ) )
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Append 'n' checked segments to the queue, all or nothing, filling in
+ * their entry speeds. */
+static uint8_t append( const MOTION_SEG *pSegs, uint8_t n )
+{
+	uint8_t head = q_head;
+	uint8_t depth;
+	uint8_t i;
+	MOTION_SEG *pSeg;
+
+	if( (uint8_t)( head - q_tail ) + n > MOTION_QUEUE_SIZE )
+	{
+		stats.rejected++;
+		return MOTION_ERR_FULL;
+	}
+
+	for( i = 0; i < n; i++ )
+	{
+		pSeg = &queue[ ( head + i ) & MOTION_QUEUE_MASK ];
+		*pSeg = pSegs[ i ];
+		pSeg->left.entry = entry_speed( &pSeg->left );
+		pSeg->right.entry = entry_speed( &pSeg->right );
+	}
+
+	q_head = head + n;		// Publish the segments to the tick.
+
+	depth = (uint8_t)( q_head - q_tail );
+	if( depth > stats.peak )
+		stats.peak = depth;
+
+	return MOTION_OK;
+}
+
+uint8_t MOTION_enqueue( const uint8_t *pPayload, uint8_t len )
+{
+	MOTION_SEG tmp[ MOTION_MAX_SEGS ];
+	uint8_t n = len / MOTION_SEG_SIZE;
+	uint8_t i;
+
+	if( ( len == 0 ) || ( len % MOTION_SEG_SIZE ) || ( n > MOTION_MAX_SEGS ) )
+		return MOTION_ERR_PARAM;
+
+	for( i = 0; i < n; i++ )
+	{
+		const uint8_t *p = &pPayload[ i * MOTION_SEG_SIZE ];
+
+		decode_wheel( &tmp[ i ].left, p );
+		decode_wheel( &tmp[ i ].right, p + MOTION_WHEEL_SIZE );
+	}
+
+	if( !segs_ok( tmp, n ) )
+		return MOTION_ERR_PARAM;
+
+	return append( tmp, n );
+}
+
+uint8_t MOTION_push( const MOTION_SEG *pSegs, uint8_t n )
+{
+	if( ( n == 0 ) || ( n > MOTION_QUEUE_SIZE ) || !segs_ok( pSegs, n ) )
+		return MOTION_ERR_PARAM;
+
+	return append( pSegs, n );
+}
+
+void MOTION_start( void )
+{
+	enabled = 1;
+}
+
+void MOTION_flush( void )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		enabled = 0;
+		busy = 0;
+		cut = 0;
+		q_head = q_tail;
+	}
+}
+
+void MOTION_next( void )
+{
+	cut = 1;
+}
+
+void MOTION_get_stats( MOTION_STATS *pStats )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		stats.depth = (uint8_t)( q_head - q_tail );
+		*pStats = stats;
+	}
+}
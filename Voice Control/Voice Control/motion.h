@@ -0,0 +1,138 @@
+/*
+ * motion.h
+ *
+ * Parameterized motion commands.  A PROTO_OP_MOVE frame carries one or more
+ * segments; each segment gives both wheels their own direction, step count,
+ * speed, acceleration and brake mode and is started with STEPENG_tick_move().
+ *
+ * Wire format of one wheel (MOTION_WHEEL_SIZE bytes, little-endian):
+ *
+ *     FLAGS | STEPS(16) | SPEED(16) | ACCEL(16)
+ *
+ *     FLAGS - MOTION_FLG_xxx.
+ *     STEPS - Distance in steps.  0 with a non-zero SPEED on both wheels
+ *             makes a free-running segment, which must be the last one.
+ *             0 with SPEED 0 leaves that wheel out of a step segment.
+ *     SPEED - Cruise speed in steps/s, 0..MOTION_MAX_SPEED.
+ *     ACCEL - Acceleration limit in steps/s^2, 0..MOTION_MAX_ACCEL.  0
+ *             disables ramping: the wheel jumps to SPEED.
+ *
+ * A segment is the left wheel followed by the right wheel.  Segments are
+ * appended to a queue that the system tick works through: step segments
+ * report their end through step_done, and the next one is loaded in the
+ * same tick that reports the previous one done (step_done), so back-to-back
+ * segments run without a gap.  A free-running segment runs until another
+ * segment is queued behind it.
+ *
+ * Profiles: the tick plans each wheel's speed itself rather than leaving
+ * the ramps to the stepper library.  Acceleration is ramped at
+ * MOTION_JERK, so speed follows an S-curve instead of a trapezoid.  A wheel
+ * that keeps its direction into the next queued segment is not stopped at
+ * the junction: it slows only to the junction speed (the lower of the two
+ * cruise speeds, and no more than the next segment can still stop from)
+ * and carries that speed over.  A free-running segment likewise slews to
+ * the junction speed before handing over.  Braking is planned from the
+ * steps remaining, so a segment queued late still blends if it arrives
+ * before the wheel has started to slow down.
+ */
+#ifndef MOTION_H_
+#define MOTION_H_
+
+#include <stdint.h>
+#include "proto.h"
+#include "stepeng.h"
+
+#define MOTION_FLG_REV		0x01	// Drive the wheel in reverse.
+#define MOTION_FLG_BRAKE	0x02	// Stop and hold the wheel braked once its steps are done.
+
+#define MOTION_WHEEL_SIZE	7
+#define MOTION_SEG_SIZE		( 2 * MOTION_WHEEL_SIZE )
+#define MOTION_MAX_SEGS		( PROTO_MAX_PAYLOAD / MOTION_SEG_SIZE )
+
+/* Speed limit of the Timer1 engine; on the DDS engine speeds are clamped to
+ * STEPENG_DDS_MAX_SPEED. */
+#define MOTION_MAX_SPEED	STEPENG_MAX_SPEED
+#define MOTION_MAX_ACCEL	1000	// STEPPER_set_accel() limit.
+
+/* Rate of change of acceleration, steps/s^3.  Reaching MOTION_MAX_ACCEL
+ * takes MOTION_MAX_ACCEL / MOTION_JERK seconds. */
+#ifndef MOTION_JERK
+	#define MOTION_JERK		5000
+#endif
+
+/* Lowest speed commanded while steps remain: the engine ends a step move
+ * whose speed reaches 0. */
+#define MOTION_MIN_SPEED	10
+
+/* Queue capacity in segments.  Power of two, at most 128. */
+#define MOTION_QUEUE_SIZE	8
+#define MOTION_QUEUE_MASK	( MOTION_QUEUE_SIZE - 1 )
+
+#if ( MOTION_QUEUE_SIZE < 2 ) || ( MOTION_QUEUE_SIZE > 128 ) || \
+    ( MOTION_QUEUE_SIZE & MOTION_QUEUE_MASK )
+	#error "MOTION_QUEUE_SIZE must be a power of two between 2 and 128"
+#endif
+
+/* MOTION_enqueue() results. */
+#define MOTION_OK			0
+#define MOTION_ERR_PARAM	1	// Payload malformed or out of range.
+#define MOTION_ERR_FULL		2	// Not enough free queue slots.
+
+typedef struct MOTION_WHEEL_TYPE {
+
+	uint8_t  flags;
+	uint16_t steps;
+	uint16_t speed;
+	uint16_t accel;
+	uint16_t entry;			// Highest speed to enter with (MOTION_enqueue()).
+
+} MOTION_WHEEL;
+
+typedef struct MOTION_SEG_TYPE {
+
+	MOTION_WHEEL left;
+	MOTION_WHEEL right;
+
+} MOTION_SEG;
+
+/* Queue statistics, see MOTION_get_stats() */
+typedef struct MOTION_STATS_TYPE {
+
+	uint16_t segments;		// Segments started.
+	uint16_t underruns;		// Times a step segment finished with the queue empty.
+	uint16_t rejected;		// Frames refused because the queue was full.
+	uint8_t  depth;			// Segments waiting right now.
+	uint8_t  peak;			// Highest depth seen.
+
+} MOTION_STATS;
+
+/* Attach the queue runner to the system tick.  Call once, after
+ * TICK_open().  Returns 0 if no tick hook slot was free. */
+uint8_t MOTION_open( void );
+
+/* Decode and check a PROTO_OP_MOVE payload and append its segments to the
+ * queue, all or nothing.  Returns MOTION_OK or a MOTION_ERR_xxx code. */
+uint8_t MOTION_enqueue( const uint8_t *pPayload, uint8_t len );
+
+/* MOTION_enqueue() for 'n' segments built in C, e.g. by kin.h.  The same
+ * rules apply; 'entry' need not be set. */
+uint8_t MOTION_push( const MOTION_SEG *pSegs, uint8_t n );
+
+/* Let the tick work through the queue.  Segments queued while stopped wait. */
+void MOTION_start( void );
+
+/* Stop taking segments and discard the queue.  The segment in progress is
+ * abandoned; whoever takes over the wheels next sets their motion. */
+void MOTION_flush( void );
+
+/* End the segment in progress at the next tick, as if it had finished
+ * there, provided another one is queued; otherwise it takes effect when
+ * one is, unless the segment has finished by then.  Wheels that keep their direction carry their speed across as at a
+ * planned junction, the others restart from rest.  Safe to call from an
+ * interrupt (e.g. a STEPENG_TRIG_NEXT_SEG trigger). */
+void MOTION_next( void );
+
+/* Snapshot the queue counters into '*pStats'. */
+void MOTION_get_stats( MOTION_STATS *pStats );
+
+#endif /* MOTION_H_ */
@@ -0,0 +1,185 @@
+/*
+ * odom.c
+ *
+ * Dead-reckoning odometry from the stepper engine's step counts.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "tick.h"
+#include "units.h"
+#include "kin.h"
+#include "stepeng.h"
+#include "odom.h"
+
+#if ODOM_PERIOD < 1 || ODOM_PERIOD > 20
+	#error "ODOM_PERIOD must be between 1 and 20 ticks"
+#endif
+
+/* Centre travel per half-step of wheel travel (the mean of both wheels),
+ * mm in Q12. */
+#define MM_PER_HALF_STEP_Q12	\
+	UNITS_Q( UNITS_STEPS_PER_MM_DEN, 2 * UNITS_STEPS_PER_MM_NUM, 12 )
+
+/* Steps a wheel can take in one period, and the check that the position
+ * products in ODOM_update() stay within 32 bits. */
+#define MAX_STEPS	( ODOM_PERIOD * STEPENG_MAX_SPEED / 1000 + 1 )
+
+#if 2ULL * MAX_STEPS * MM_PER_HALF_STEP_Q12 * 16384 > 0x7FFFFFFF
+	#error "ODOM_PERIOD too long for STEPENG_MAX_SPEED"
+#endif
+
+/* Heading change per step of difference between the wheels, binary angle
+ * in Q16: a step turns the robot by pi * D / ( STEPS_PER_RVLTN * T )
+ * radians, and pi cancels against the 2 * pi of a turn. */
+#define BAM_PER_STEP_Q16	\
+	UNITS_Q( 65536ULL * UNITS_WHEEL_DIAM, 2ULL * STEPS_PER_RVLTN * KIN_TRACK, 16 )
+
+/* sin() over a quarter turn in 256 steps, Q14. */
+static const int16_t sin_table[ 257 ] PROGMEM = {
+
+	    0,   101,   201,   302,   402,   503,   603,   704,   804,   904,
+	 1005,  1105,  1205,  1306,  1406,  1506,  1606,  1706,  1806,  1906,
+	 2006,  2105,  2205,  2305,  2404,  2503,  2603,  2702,  2801,  2900,
+	 2999,  3098,  3196,  3295,  3393,  3492,  3590,  3688,  3786,  3883,
+	 3981,  4078,  4176,  4273,  4370,  4467,  4563,  4660,  4756,  4852,
+	 4948,  5044,  5139,  5235,  5330,  5425,  5520,  5614,  5708,  5803,
+	 5897,  5990,  6084,  6177,  6270,  6363,  6455,  6547,  6639,  6731,
+	 6823,  6914,  7005,  7096,  7186,  7276,  7366,  7456,  7545,  7635,
+	 7723,  7812,  7900,  7988,  8076,  8163,  8250,  8337,  8423,  8509,
+	 8595,  8680,  8765,  8850,  8935,  9019,  9102,  9186,  9269,  9352,
+	 9434,  9516,  9598,  9679,  9760,  9841,  9921, 10001, 10080, 10159,
+	10238, 10316, 10394, 10471, 10549, 10625, 10702, 10778, 10853, 10928,
+	11003, 11077, 11151, 11224, 11297, 11370, 11442, 11514, 11585, 11656,
+	11727, 11797, 11866, 11935, 12004, 12072, 12140, 12207, 12274, 12340,
+	12406, 12472, 12537, 12601, 12665, 12729, 12792, 12854, 12916, 12978,
+	13039, 13100, 13160, 13219, 13279, 13337, 13395, 13453, 13510, 13567,
+	13623, 13678, 13733, 13788, 13842, 13896, 13949, 14001, 14053, 14104,
+	14155, 14206, 14256, 14305, 14354, 14402, 14449, 14497, 14543, 14589,
+	14635, 14680, 14724, 14768, 14811, 14854, 14896, 14937, 14978, 15019,
+	15059, 15098, 15137, 15175, 15213, 15250, 15286, 15322, 15357, 15392,
+	15426, 15460, 15493, 15525, 15557, 15588, 15619, 15649, 15679, 15707,
+	15736, 15763, 15791, 15817, 15843, 15868, 15893, 15917, 15941, 15964,
+	15986, 16008, 16029, 16049, 16069, 16088, 16107, 16125, 16143, 16160,
+	16176, 16192, 16207, 16221, 16235, 16248, 16261, 16273, 16284, 16295,
+	16305, 16315, 16324, 16332, 16340, 16347, 16353, 16359, 16364, 16369,
+	16373, 16376, 16379, 16381, 16383, 16384, 16384
+};
+
+/* Tick state. */
+static int8_t count_L, count_R;		// Steps since the last update.
+static uint8_t period;				// Ticks to the next update.
+static uint32_t heading;			// Binary angle in Q16; wraps with the turn.
+static int32_t x, y;				// mm in Q12.
+
+/* Published pose.  The tick bumps 'seq' after each update. */
+static volatile ODOM_POSE pose;
+static volatile uint8_t seq;
+
+/* sin( 'a' ) in Q14, interpolated between the table entries. */
+static int16_t sin14( uint16_t a )
+{
+	uint16_t q = a & 0x3FFF;
+	uint16_t i;		// Up to 256.
+	uint8_t f;
+	int16_t s;
+
+	if( a & 0x4000 )
+		q = 0x4000 - q;		// Second and fourth quadrant: mirror.
+
+	i = q >> 6;
+	f = q & 0x3F;
+
+	s = pgm_read_word( &sin_table[ i ] );
+	if( f )
+		s += ( ( (int16_t) pgm_read_word( &sin_table[ i + 1 ] ) - s ) * f + 32 ) >> 6;
+
+	return ( a & 0x8000 ) ? -s : s;
+}
+
+/* Fold the steps collected over the last period into the pose. */
+static void ODOM_update( void )
+{
+	int32_t turn = (int32_t)( count_R - count_L ) * (int32_t) BAM_PER_STEP_Q16;
+	int32_t ds = (int32_t)( count_L + count_R ) * (int32_t) MM_PER_HALF_STEP_Q12;
+	uint16_t mid = ( heading + turn / 2 ) >> 16;
+
+	if( ds )
+	{
+		x += ( ds * sin14( mid + 0x4000 ) + ( 1L << 13 ) ) >> 14;
+		y += ( ds * sin14( mid ) + ( 1L << 13 ) ) >> 14;
+	}
+	heading += turn;
+
+	pose.x = ( x + ( 1L << 11 ) ) >> 12;
+	pose.y = ( y + ( 1L << 11 ) ) >> 12;
+	pose.heading = heading >> 16;
+	pose.speed_left = ( STEPPER_params.dir_mode.left == STEPPER_REV ) ?
+		-STEPPER_params.curr_speed.left : STEPPER_params.curr_speed.left;
+	pose.speed_right = ( STEPPER_params.dir_mode.right == STEPPER_REV ) ?
+		-STEPPER_params.curr_speed.right : STEPPER_params.curr_speed.right;
+	pose.steps_left += count_L;
+	pose.steps_right += count_R;
+	pose.stamp = TICK_count();
+	seq++;
+
+	count_L = 0;
+	count_R = 0;
+}
+
+/* Tick hook: runs after the stepper clock, so any step of this tick is
+ * seen. */
+static void ODOM_tick( void )
+{
+	int8_t left, right;
+
+	STEPENG_take_steps( &left, &right );
+	count_L += left;
+	count_R += right;
+
+	if( --period == 0 )
+	{
+		period = ODOM_PERIOD;
+		ODOM_update();
+	}
+}
+
+uint8_t ODOM_open( void )
+{
+	ODOM_reset();
+	return TICK_attach( ODOM_tick );
+}
+
+void ODOM_reset( void )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		STEPENG_take_steps( &count_L, &count_R );	// Drop the steps so far.
+		count_L = 0;
+		count_R = 0;
+		period = ODOM_PERIOD;
+		heading = 0;
+		x = 0;
+		y = 0;
+
+		pose.x = 0;
+		pose.y = 0;
+		pose.heading = 0;
+		pose.steps_left = 0;
+		pose.steps_right = 0;
+		seq++;
+	}
+}
+
+void ODOM_get( ODOM_POSE *pPose )
+{
+	uint8_t s;
+
+	/* The tick updates the pose in one go, so a copy it did not interrupt
+	 * is consistent. */
+	do {
+		s = seq;
+		*pPose = pose;
+	} while( s != seq );
+}
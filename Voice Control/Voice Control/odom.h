@@ -0,0 +1,52 @@
+/*
+ * odom.h
+ *
+ * Dead-reckoning odometry.  Every system tick the wheel steps actually
+ * taken are picked up from the stepper engine (STEPENG_take_steps()), in
+ * step and free-running mode alike.  Every ODOM_PERIOD ticks the steps
+ * collected are folded into the pose, using the heading at the middle of
+ * the interval, a sin/cos table and integer arithmetic only.
+ *
+ * Frame: the pose starts at x = y = 0 facing along +x.  Headings are
+ * binary angles (65536 per turn, see units.h), counter-clockwise, so a
+ * left turn raises the heading.
+ *
+ * The pose is published to a snapshot guarded by a sequence count, so
+ * ODOM_get() copies it with interrupts enabled and simply retries if the
+ * tick updated it meanwhile.
+ */
+#ifndef ODOM_H_
+#define ODOM_H_
+
+#include <stdint.h>
+
+/* Ticks (~1 ms) per pose update. */
+#ifndef ODOM_PERIOD
+	#define ODOM_PERIOD		10
+#endif
+
+typedef struct ODOM_POSE_TYPE {
+
+	int32_t  x;				// Position, mm.
+	int32_t  y;
+	uint16_t heading;		// Binary angle.
+	int16_t  speed_left;	// Current wheel speeds, steps/s, negative in reverse.
+	int16_t  speed_right;
+	int32_t  steps_left;	// Net steps since ODOM_reset().
+	int32_t  steps_right;
+	uint32_t stamp;			// TICK_count() of the last update.
+
+} ODOM_POSE;
+
+/* Attach the step counter to the system tick and reset the pose.  Call
+ * once, after STEPENG_open() and TICK_open().  Returns 0 if no tick hook
+ * slot was free. */
+uint8_t ODOM_open( void );
+
+/* Make the current position the origin, facing along +x. */
+void ODOM_reset( void );
+
+/* Copy the latest pose into '*pPose'. */
+void ODOM_get( ODOM_POSE *pPose );
+
+#endif /* ODOM_H_ */
@@ -0,0 +1,372 @@
+/*
+ * proto.c
+ *
+ * Incremental frame parser and reply encoder for the USART0 command link.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <avr/pgmspace.h>
+#include "usart.h"
+#include "proto.h"
+
+/* PROTO_send() queues a frame only if it fits the transmit ring whole. */
+#if USART_TX_SIZE < PROTO_MAX_PAYLOAD + 5
+	#error "USART_TX_SIZE must hold a PROTO_MAX_PAYLOAD frame"
+#endif
+
+/* Parser states, one per frame field. */
+typedef enum PROTO_PSTATE_TYPE {
+
+	PROTO_WAIT_SOF = 0,
+	PROTO_WAIT_LEN,
+	PROTO_WAIT_SEQ,
+	PROTO_WAIT_OP,
+	PROTO_WAIT_PAYLOAD,
+	PROTO_WAIT_CRC
+
+} PROTO_PSTATE;
+
+/* Baud negotiation states. */
+typedef enum PROTO_BSTATE_TYPE {
+
+	PROTO_BAUD_IDLE = 0,	// No switch in progress.
+	PROTO_BAUD_TRIAL,		// Switched; waiting for a good frame at the new rate.
+	PROTO_BAUD_SETTLING		// Confirmed (or fallen back); trial timer still queued.
+
+} PROTO_BSTATE;
+
+/* CRC-8, polynomial x^8 + x^2 + x + 1 (0x07), one lookup per byte. */
+static const uint8_t crc8_LUT[ 256 ] PROGMEM = {
+	0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+	0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+	0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65,
+	0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+	0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5,
+	0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+	0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85,
+	0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+	0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2,
+	0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+	0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2,
+	0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+	0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32,
+	0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+	0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42,
+	0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+	0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C,
+	0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+	0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC,
+	0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+	0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C,
+	0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+	0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C,
+	0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+	0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B,
+	0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+	0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B,
+	0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+	0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB,
+	0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+	0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB,
+	0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3
+};
+
+#define CRC8( crc, b )	pgm_read_byte( &crc8_LUT[ (uint8_t)( ( crc ) ^ ( b ) ) ] )
+
+static PROTO_FRAME frame;
+static PROTO_PSTATE pstate;
+static uint8_t crc;
+static uint8_t idx;
+
+static PROTO_STATS stats;
+
+static uint8_t last_valid;	// Non-zero once a frame has been ACKed.
+static uint8_t last_seq;
+static uint8_t last_op;
+
+static PROTO_BSTATE bstate;
+static TIMEROBJ baud_timer;
+static uint16_t fe_mark;	// USART framing error count at the last good frame.
+
+void PROTO_init( void )
+{
+	pstate = PROTO_WAIT_SOF;
+	last_valid = 0;
+	bstate = PROTO_BAUD_IDLE;
+	fe_mark = 0;
+
+	stats.frames_ok = 0;
+	stats.crc_errors = 0;
+	stats.len_errors = 0;
+	stats.duplicates = 0;
+	stats.baud_fallbacks = 0;
+	stats.tx_dropped = 0;
+	stats.bad_run = 0;
+}
+
+static void PROTO_count_bad( void )
+{
+	if( stats.bad_run < 0xFF )
+		stats.bad_run++;
+}
+
+/* Give up on a fast rate and return to 9600 baud. */
+static void PROTO_fallback( void )
+{
+	USART_set_baud( USART_BAUD_9600 );
+
+	stats.baud_fallbacks++;
+	stats.bad_run = 0;
+	pstate = PROTO_WAIT_SOF;
+
+	if( bstate == PROTO_BAUD_TRIAL )
+		bstate = PROTO_BAUD_SETTLING;
+}
+
+/* Fall back if the link at a fast rate has gone bad.  Framing errors count
+ * as well as bad frames: at a mismatched rate most garbage never even
+ * produces a start-of-frame byte. */
+static void PROTO_check_link( void )
+{
+	USART_STATS us;
+	uint16_t errors = stats.bad_run;
+
+	if( USART_get_baud() == USART_BAUD_9600 )
+		return;
+
+	USART_get_stats( &us );
+	if( us.rx_frame_errors >= fe_mark )
+		errors += us.rx_frame_errors - fe_mark;
+	else
+		fe_mark = us.rx_frame_errors;	// Counters were cleared.
+
+	if( errors >= PROTO_BAUD_MAX_BAD )
+		PROTO_fallback();
+}
+
+/* A good frame arrived: the current rate works. */
+static void PROTO_link_good( void )
+{
+	USART_STATS us;
+
+	USART_get_stats( &us );
+	fe_mark = us.rx_frame_errors;
+
+	if( bstate == PROTO_BAUD_TRIAL )
+		bstate = PROTO_BAUD_SETTLING;
+}
+
+/* Handle PROTO_OP_SET_BAUD. */
+static void PROTO_set_baud( const PROTO_FRAME *pFrame )
+{
+	if( ( pFrame->len != 1 ) || ( pFrame->payload[ 0 ] >= USART_BAUD_COUNT ) )
+	{
+		PROTO_nak( pFrame->seq, PROTO_NAK_PARAM );
+		return;
+	}
+
+	/* The trial timer must leave the timer service list before it can be
+	 * submitted again. */
+	if( bstate != PROTO_BAUD_IDLE )
+	{
+		PROTO_nak( pFrame->seq, PROTO_NAK_BUSY );
+		return;
+	}
+
+	PROTO_ack( pFrame );	// Still at the old rate.
+	USART_set_baud( pFrame->payload[ 0 ] );
+	pstate = PROTO_WAIT_SOF;
+
+	if( pFrame->payload[ 0 ] != USART_BAUD_9600 )
+	{
+		PROTO_link_good();		// Restart the framing error baseline.
+
+		baud_timer.tc = 0;
+		TMRSRVC_new( &baud_timer, TMRFLG_NOTIFY_FLAG, TMR_TCM_RUNONCE,
+															PROTO_BAUD_TRIAL_MS );
+		bstate = PROTO_BAUD_TRIAL;
+	}
+}
+
+/* Feed one byte to the parser.  Returns 1 when 'frame' holds a complete,
+ * checksum-verified frame. */
+static uint8_t PROTO_parse( uint8_t b )
+{
+	switch( pstate )
+	{
+		case PROTO_WAIT_SOF:
+			if( b == PROTO_SOF )
+			{
+				crc = 0;
+				pstate = PROTO_WAIT_LEN;
+			}
+			break;
+
+		case PROTO_WAIT_LEN:
+			if( b > PROTO_MAX_PAYLOAD )
+			{
+				stats.len_errors++;
+				PROTO_count_bad();
+				pstate = PROTO_WAIT_SOF;
+				PROTO_nak( 0, PROTO_NAK_LENGTH );	// SEQ not yet known.
+				break;
+			}
+			frame.len = b;
+			crc = CRC8( crc, b );
+			pstate = PROTO_WAIT_SEQ;
+			break;
+
+		case PROTO_WAIT_SEQ:
+			frame.seq = b;
+			crc = CRC8( crc, b );
+			pstate = PROTO_WAIT_OP;
+			break;
+
+		case PROTO_WAIT_OP:
+			frame.op = b;
+			crc = CRC8( crc, b );
+			idx = 0;
+			pstate = frame.len ? PROTO_WAIT_PAYLOAD : PROTO_WAIT_CRC;
+			break;
+
+		case PROTO_WAIT_PAYLOAD:
+			frame.payload[ idx++ ] = b;
+			crc = CRC8( crc, b );
+			if( idx == frame.len )
+				pstate = PROTO_WAIT_CRC;
+			break;
+
+		case PROTO_WAIT_CRC:
+			pstate = PROTO_WAIT_SOF;
+			if( b != crc )
+			{
+				stats.crc_errors++;
+				PROTO_count_bad();
+				PROTO_nak( frame.seq, PROTO_NAK_CRC );
+				break;
+			}
+			stats.frames_ok++;
+			stats.bad_run = 0;
+			return 1;
+	}
+
+	return 0;
+}
+
+PROTO_FRAME *PROTO_poll( void )
+{
+	uint8_t b;
+	uint16_t mark;
+
+	PROTO_check_link();
+
+	while( USART_getc_mark( &b, &mark ) )
+	{
+		if( !PROTO_parse( b ) )
+			continue;
+
+		frame.rx_mark = mark;
+
+		PROTO_link_good();
+
+		if( last_valid && frame.seq == last_seq && frame.op == last_op &&
+			!PROTO_IS_QUERY( frame.op ) )
+		{
+			/* Our ACK was lost and the host resent the command. */
+			stats.duplicates++;
+			PROTO_send( frame.seq, PROTO_OP_ACK, &frame.op, 1 );
+			continue;
+		}
+
+		switch( frame.op )
+		{
+			case PROTO_OP_PING:
+				/* Harmless to repeat, so not remembered as a command. */
+				PROTO_send( frame.seq, PROTO_OP_ACK, &frame.op, 1 );
+				continue;
+
+			case PROTO_OP_SET_BAUD:
+				PROTO_set_baud( &frame );
+				continue;
+		}
+
+		return &frame;
+	}
+
+	/* Only judge the trial once everything received so far was parsed, so
+	 * a confirming frame that waited in the ring still counts. */
+	if( ( bstate != PROTO_BAUD_IDLE ) && baud_timer.tc )
+	{
+		if( bstate == PROTO_BAUD_TRIAL )
+			PROTO_fallback();
+		bstate = PROTO_BAUD_IDLE;
+	}
+
+	PROTO_check_link();
+
+	return 0;
+}
+
+void PROTO_ack( const PROTO_FRAME *pFrame )
+{
+	last_valid = 1;
+	last_seq = pFrame->seq;
+	last_op = pFrame->op;
+
+	PROTO_send( pFrame->seq, PROTO_OP_ACK, &pFrame->op, 1 );
+}
+
+void PROTO_reply( const PROTO_FRAME *pFrame, const uint8_t *pData, uint8_t len )
+{
+	uint8_t buf[ PROTO_MAX_PAYLOAD ];
+	uint8_t i;
+
+	if( len > PROTO_MAX_PAYLOAD - 1 )
+	{
+		PROTO_nak( pFrame->seq, PROTO_NAK_TOO_LONG );
+		return;
+	}
+
+	buf[ 0 ] = pFrame->op;
+	for( i = 0; i < len; i++ )
+		buf[ i + 1 ] = pData[ i ];
+
+	/* Queries are not remembered: one between a command and its
+	 * retransmission must not hide the duplicate. */
+	PROTO_send( pFrame->seq, PROTO_OP_DATA, buf, len + 1 );
+}
+
+void PROTO_nak( uint8_t seq, uint8_t reason )
+{
+	PROTO_send( seq, PROTO_OP_NAK, &reason, 1 );
+}
+
+void PROTO_send( uint8_t seq, uint8_t op, const uint8_t *pPayload, uint8_t len )
+{
+	uint8_t c = 0;
+	uint8_t i;
+
+	if( USART_tx_free() < len + 5 )		// SOF, LEN, SEQ, OP, CRC + payload.
+	{
+		stats.tx_dropped++;
+		return;
+	}
+
+	USART_putc( PROTO_SOF );
+	USART_putc( len );	c = CRC8( c, len );
+	USART_putc( seq );	c = CRC8( c, seq );
+	USART_putc( op );	c = CRC8( c, op );
+
+	for( i = 0; i < len; i++ )
+	{
+		USART_putc( pPayload[ i ] );
+		c = CRC8( c, pPayload[ i ] );
+	}
+
+	USART_putc( c );
+}
+
+void PROTO_get_stats( PROTO_STATS *pStats )
+{
+	*pStats = stats;
+}
@@ -0,0 +1,141 @@
+/*
+ * proto.h
+ *
+ * Framed command protocol spoken over USART0.
+ *
+ * Every message, in both directions, is carried in a frame:
+ *
+ *     SOF | LEN | SEQ | OP | PAYLOAD[LEN] | CRC
+ *
+ *     SOF     - Start of frame, always PROTO_SOF.
+ *     LEN     - Payload length in bytes (0..PROTO_MAX_PAYLOAD).
+ *     SEQ     - Sequence number chosen by the sender; echoed in the reply.
+ *     OP      - Opcode (PROTO_OP_xxx).
+ *     PAYLOAD - Opcode specific arguments, multi-byte values little-endian.
+ *     CRC     - CRC-8 (polynomial 0x07, initial value 0) over LEN..PAYLOAD.
+ *
+ * The robot answers every command frame with an ACK carrying the accepted
+ * opcode, or a NAK carrying a PROTO_NAK_xxx reason.  Queries are answered
+ * with a DATA frame instead of the ACK.  Commands are executed
+ * in arrival order, so the host may keep several frames in flight and match
+ * the replies by sequence number.  A frame that repeats the sequence number
+ * and opcode of the previous accepted command is treated as a
+ * retransmission: it is ACKed again but not executed twice.  Queries and
+ * PROTO_OP_PING have no effect to repeat and are not remembered, so they
+ * may come between a command and its retransmission.
+ *
+ * Baud negotiation: PROTO_OP_SET_BAUD is ACKed at the current rate, after
+ * which both ends switch.  The host must then get a good frame through
+ * (PROTO_OP_PING will do) within PROTO_BAUD_TRIAL_MS, or the robot falls
+ * back to 9600 baud.  It also falls back whenever PROTO_BAUD_MAX_BAD bad
+ * frames or framing errors arrive in a row at a fast rate, so a host that
+ * loses sync can always recover by reconnecting at 9600.
+ */
+#ifndef PROTO_H_
+#define PROTO_H_
+
+#include <stdint.h>
+
+#define PROTO_SOF			0xA5
+#define PROTO_MAX_PAYLOAD	64
+
+#define PROTO_BAUD_TRIAL_MS	1000	// Time allowed to confirm a new rate.
+#define PROTO_BAUD_MAX_BAD	3		// Errors in a row that force 9600 baud.
+
+/* Command opcodes (host to robot).  The motion opcodes keep the values of
+ * the original single-byte commands. */
+#define PROTO_OP_STOP		0x00
+#define PROTO_OP_BACKWARD	0x01
+#define PROTO_OP_FORWARD	0x02
+#define PROTO_OP_TURNRIGHT	0x03
+#define PROTO_OP_TURNLEFT	0x04
+#define PROTO_OP_TURNAROUND	0x05
+#define PROTO_OP_MOVE		0x06	// Payload: motion segments, see motion.h.
+
+/* Query opcodes (0x20..0x2F), answered with PROTO_OP_DATA.  Queries have
+ * no side effects, so a repeated one is simply answered again. */
+#define PROTO_OP_GET_LOOP_RATE	0x20	// Reply: uint32_t main loop passes/s.
+#define PROTO_OP_GET_MOTION_STATS	0x21	// Reply: MOTION_STATS.
+#define PROTO_OP_GET_STOP_LATENCY	0x22	// Reply: LATENCY_STOP.
+#define PROTO_OP_GET_LATENCY_HIST	0x23	// Payload: row.  Reply: row, histogram.
+#define PROTO_OP_GET_IDLE_STATS		0x24	// Reply: IDLE_STATS.
+#define PROTO_OP_GET_FMT_BENCH		0x25	// Reply: FMT_BENCH_RESULT (FMT_BENCH builds).
+#define PROTO_OP_GET_POSE			0x26	// Reply: ODOM_POSE.
+#define PROTO_OP_GET_POWER_STATS	0x27	// Reply: STEPPWR_STATS.
+#define PROTO_OP_GET_STEP_BENCH	0x28	// Reply: STEPENG_BENCH_RESULT (STEPENG_BENCH builds).
+#define PROTO_OP_GET_STEP_LOAD	0x29	// Reply: STEPENG_LOAD.
+
+#define PROTO_IS_QUERY( op )	( ( ( op ) & 0xF0 ) == 0x20 )
+
+/* Link opcodes, handled inside PROTO_poll(). */
+#define PROTO_OP_PING		0x10	// No payload.  ACKed, nothing else.
+#define PROTO_OP_SET_BAUD	0x11	// Payload: USART_BAUD index.
+
+/* Reply opcodes (robot to host). */
+#define PROTO_OP_ACK		0x80	// Payload: accepted opcode.
+#define PROTO_OP_NAK		0x81	// Payload: PROTO_NAK_xxx reason.
+#define PROTO_OP_DATA		0x82	// Payload: query opcode, then its data.
+#define PROTO_OP_TEXT		0x83	// Payload: text, not terminated.  Unsolicited, SEQ 0.
+
+/* NAK reasons. */
+#define PROTO_NAK_CRC		0x01	// Checksum mismatch.
+#define PROTO_NAK_LENGTH	0x02	// LEN larger than PROTO_MAX_PAYLOAD.
+#define PROTO_NAK_OPCODE	0x03	// Unknown opcode.
+#define PROTO_NAK_PARAM		0x04	// Payload malformed or out of range.
+#define PROTO_NAK_BUSY		0x05	// Command cannot be accepted right now (queue full).
+#define PROTO_NAK_TOO_LONG	0x06	// Query reply larger than PROTO_MAX_PAYLOAD.
+
+/* A received, checksum-verified frame. */
+typedef struct PROTO_FRAME_TYPE {
+
+	uint8_t len;
+	uint8_t seq;
+	uint8_t op;
+	uint8_t payload[ PROTO_MAX_PAYLOAD ];
+	uint16_t rx_mark;		// TICK_mark() of the CRC byte's RX interrupt.
+
+} PROTO_FRAME;
+
+/* Receive side counters, see PROTO_get_stats() */
+typedef struct PROTO_STATS_TYPE {
+
+	uint16_t frames_ok;		// Frames that passed the checksum.
+	uint16_t crc_errors;	// Frames dropped for a bad checksum.
+	uint16_t len_errors;	// Frames dropped for an oversized LEN.
+	uint16_t duplicates;	// Retransmissions that were re-ACKed only.
+	uint16_t baud_fallbacks; // Times the link was dropped back to 9600.
+	uint16_t tx_dropped;	// Outgoing frames discarded for lack of ring space.
+	uint8_t  bad_run;		// Consecutive bad frames since the last good one.
+
+} PROTO_STATS;
+
+/* Reset the parser and counters. */
+void PROTO_init( void );
+
+/* Run the incremental parser over the bytes queued in the USART0 receive
+ * ring until one new command frame is complete or the ring is empty.  Bad
+ * frames are NAKed, retransmissions re-ACKed and the link opcodes answered
+ * here.  Returns the frame, which stays valid until the next call, or NULL
+ * if none is ready. */
+PROTO_FRAME *PROTO_poll( void );
+
+/* Accept 'pFrame': reply with an ACK and remember it for duplicate
+ * detection. */
+void PROTO_ack( const PROTO_FRAME *pFrame );
+
+/* Accept the query 'pFrame': reply with a DATA frame carrying its opcode
+ * followed by 'len' bytes from 'pData'.  If that is over
+ * PROTO_MAX_PAYLOAD bytes, NAK it with PROTO_NAK_TOO_LONG instead. */
+void PROTO_reply( const PROTO_FRAME *pFrame, const uint8_t *pData, uint8_t len );
+
+/* Reject the frame with sequence number 'seq' for 'reason'. */
+void PROTO_nak( uint8_t seq, uint8_t reason );
+
+/* Queue a frame for the host.  Never waits: if the transmit ring cannot
+ * take the whole frame it is dropped and counted, never sent in part. */
+void PROTO_send( uint8_t seq, uint8_t op, const uint8_t *pPayload, uint8_t len );
+
+/* Snapshot the receive counters into '*pStats'. */
+void PROTO_get_stats( PROTO_STATS *pStats );
+
+#endif /* PROTO_H_ */
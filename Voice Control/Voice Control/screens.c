@@ -0,0 +1,139 @@
+/*
+ * screens.c
+ *
+ * Generated by tools/mkscreens.py from screens.txt.  Do not edit.
+ */
+#include <avr/pgmspace.h>
+#include "screens.h"
+
+/* Try saying: */
+static const uint8_t BANNER_0[] PROGMEM = {
+	0x80, 0x80, 0xFE, 0x80, 0x80, 0x00, 0x3E, 0x10, 0x20, 0x20, 0x10, 0x00,
+	0x30, 0x0A, 0x0A, 0x0A, 0x3C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x12, 0x2A, 0x2A, 0x2A, 0x04, 0x00, 0x04, 0x2A, 0x2A, 0x2A, 0x1E, 0x00,
+	0x30, 0x0A, 0x0A, 0x0A, 0x3C, 0x00, 0x00, 0x22, 0xBE, 0x02, 0x00, 0x00,
+	0x3E, 0x10, 0x20, 0x20, 0x1E, 0x00, 0x30, 0x4A, 0x4A, 0x4A, 0x7C, 0x00,
+	0x00, 0x6C, 0x6C, 0x00, 0x00, 0x00,
+};
+
+/* "CEENbot Go" */
+static const uint8_t BANNER_1[] PROGMEM = {
+	0x00, 0xE0, 0x00, 0xE0, 0x00, 0x00, 0x7C, 0x82, 0x82, 0x82, 0x44, 0x00,
+	0xFE, 0x92, 0x92, 0x92, 0x82, 0x00, 0xFE, 0x92, 0x92, 0x92, 0x82, 0x00,
+	0xFE, 0x20, 0x10, 0x08, 0xFE, 0x00, 0xFE, 0x12, 0x22, 0x22, 0x1C, 0x00,
+	0x1C, 0x22, 0x22, 0x22, 0x1C, 0x00, 0x20, 0xFC, 0x22, 0x02, 0x04, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7C, 0x82, 0x92, 0x92, 0x5E, 0x00,
+	0x1C, 0x22, 0x22, 0x22, 0x1C, 0x00, 0x00, 0xE0, 0x00, 0xE0, 0x00, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_BANNER PROGMEM = {{
+	{ BANNER_0, 66 },
+	{ BANNER_1, 72 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
+
+/* Stop */
+static const uint8_t STOP_0[] PROGMEM = {
+	0x62, 0x92, 0x92, 0x92, 0x8C, 0x00, 0x20, 0xFC, 0x22, 0x02, 0x04, 0x00,
+	0x1C, 0x22, 0x22, 0x22, 0x1C, 0x00, 0x3E, 0x28, 0x28, 0x28, 0x10, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_STOP PROGMEM = {{
+	{ STOP_0, 24 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
+
+/* Backward */
+static const uint8_t BACKWARD_0[] PROGMEM = {
+	0xFE, 0x92, 0x92, 0x92, 0x6C, 0x00, 0x04, 0x2A, 0x2A, 0x2A, 0x1E, 0x00,
+	0x1C, 0x22, 0x22, 0x22, 0x04, 0x00, 0xFE, 0x08, 0x14, 0x22, 0x00, 0x00,
+	0x3C, 0x02, 0x0C, 0x02, 0x3C, 0x00, 0x04, 0x2A, 0x2A, 0x2A, 0x1E, 0x00,
+	0x3E, 0x10, 0x20, 0x20, 0x10, 0x00, 0x1C, 0x22, 0x22, 0x12, 0xFE, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_BACKWARD PROGMEM = {{
+	{ BACKWARD_0, 48 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
+
+/* Forward */
+static const uint8_t FORWARD_0[] PROGMEM = {
+	0xFE, 0x90, 0x90, 0x90, 0x80, 0x00, 0x1C, 0x22, 0x22, 0x22, 0x1C, 0x00,
+	0x3E, 0x10, 0x20, 0x20, 0x10, 0x00, 0x3C, 0x02, 0x0C, 0x02, 0x3C, 0x00,
+	0x04, 0x2A, 0x2A, 0x2A, 0x1E, 0x00, 0x3E, 0x10, 0x20, 0x20, 0x10, 0x00,
+	0x1C, 0x22, 0x22, 0x12, 0xFE, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_FORWARD PROGMEM = {{
+	{ FORWARD_0, 42 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
+
+/* Turn Right */
+static const uint8_t TURNRIGHT_0[] PROGMEM = {
+	0x80, 0x80, 0xFE, 0x80, 0x80, 0x00, 0x3C, 0x02, 0x02, 0x04, 0x3E, 0x00,
+	0x3E, 0x10, 0x20, 0x20, 0x10, 0x00, 0x3E, 0x10, 0x20, 0x20, 0x1E, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0x90, 0x98, 0x94, 0x62, 0x00,
+	0x00, 0x22, 0xBE, 0x02, 0x00, 0x00, 0x30, 0x4A, 0x4A, 0x4A, 0x7C, 0x00,
+	0xFE, 0x10, 0x20, 0x20, 0x1E, 0x00, 0x20, 0xFC, 0x22, 0x02, 0x04, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_TURNRIGHT PROGMEM = {{
+	{ TURNRIGHT_0, 60 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
+
+/* Turn Left */
+static const uint8_t TURNLEFT_0[] PROGMEM = {
+	0x80, 0x80, 0xFE, 0x80, 0x80, 0x00, 0x3C, 0x02, 0x02, 0x04, 0x3E, 0x00,
+	0x3E, 0x10, 0x20, 0x20, 0x10, 0x00, 0x3E, 0x10, 0x20, 0x20, 0x1E, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0x02, 0x02, 0x02, 0x02, 0x00,
+	0x1C, 0x2A, 0x2A, 0x2A, 0x18, 0x00, 0x10, 0x7E, 0x90, 0x80, 0x40, 0x00,
+	0x20, 0xFC, 0x22, 0x02, 0x04, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_TURNLEFT PROGMEM = {{
+	{ TURNLEFT_0, 54 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
+
+/* Turn Around */
+static const uint8_t TURNAROUND_0[] PROGMEM = {
+	0x80, 0x80, 0xFE, 0x80, 0x80, 0x00, 0x3C, 0x02, 0x02, 0x04, 0x3E, 0x00,
+	0x3E, 0x10, 0x20, 0x20, 0x10, 0x00, 0x3E, 0x10, 0x20, 0x20, 0x1E, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7E, 0x88, 0x88, 0x88, 0x7E, 0x00,
+	0x3E, 0x10, 0x20, 0x20, 0x10, 0x00, 0x1C, 0x22, 0x22, 0x22, 0x1C, 0x00,
+	0x3C, 0x02, 0x02, 0x04, 0x3E, 0x00, 0x3E, 0x10, 0x20, 0x20, 0x1E, 0x00,
+	0x1C, 0x22, 0x22, 0x12, 0xFE, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_TURNAROUND PROGMEM = {{
+	{ TURNAROUND_0, 66 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
+
+/* Move */
+static const uint8_t MOVE_0[] PROGMEM = {
+	0xFE, 0x40, 0x30, 0x40, 0xFE, 0x00, 0x1C, 0x22, 0x22, 0x22, 0x1C, 0x00,
+	0x38, 0x04, 0x02, 0x04, 0x38, 0x00, 0x1C, 0x2A, 0x2A, 0x2A, 0x18, 0x00,
+};
+
+const LCDFB_SCREEN SCREEN_MOVE PROGMEM = {{
+	{ MOVE_0, 24 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+	{ NULL, 0 },
+}};
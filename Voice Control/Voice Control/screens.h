@@ -0,0 +1,20 @@
+/*
+ * screens.h
+ *
+ * Generated by tools/mkscreens.py from screens.txt.  Do not edit.
+ */
+#ifndef SCREENS_H_
+#define SCREENS_H_
+
+#include "lcdfb.h"
+
+extern const LCDFB_SCREEN SCREEN_BANNER;
+extern const LCDFB_SCREEN SCREEN_STOP;
+extern const LCDFB_SCREEN SCREEN_BACKWARD;
+extern const LCDFB_SCREEN SCREEN_FORWARD;
+extern const LCDFB_SCREEN SCREEN_TURNRIGHT;
+extern const LCDFB_SCREEN SCREEN_TURNLEFT;
+extern const LCDFB_SCREEN SCREEN_TURNAROUND;
+extern const LCDFB_SCREEN SCREEN_MOVE;
+
+#endif /* SCREENS_H_ */
@@ -0,0 +1,907 @@
+/*
+ * stepeng.c
+ *
+ * Stepper engines: the API's DDS clock, or steps timed by Timer1 compares.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <util/atomic.h>
+#include "tick.h"
+#include "motion.h"
+#include "stepeng.h"
+
+#define TIMER_HZ	( F_CPU / 64 )	// Timer1 counts per second (3.2 us each).
+#define MARGIN		2				// Counts: the nearest compare that cannot be missed.
+
+#if TIMER_HZ / STEPENG_MIN_SPEED > 0xFFFF
+	#error "STEPENG_MIN_SPEED is too slow for a 16-bit period"
+#endif
+
+/* Per-motor Timer1 resources. */
+#define OCR( w )		( *( ( w ) ? &OCR1B : &OCR1A ) )
+#define OCIE_BIT( w )	( ( w ) ? ( 1 << OCIE1B ) : ( 1 << OCIE1A ) )
+#define OCF_BIT( w )	( ( w ) ? ( 1 << OCF1B ) : ( 1 << OCF1A ) )
+#define LUT( w )		( ( w ) ? Motor_R_LUT : Motor_L_LUT )
+
+/* Coil bits of each motor on PORTC; PC0 and PC1 are not ours. */
+static const uint8_t coil_mask[ 2 ] = { 0x1C, 0xE0 };
+
+/* Engine state of one motor.  The Timer1 engine's compare interrupt works
+ * on this struct alone rather than on the STEPPER_params pairs, which are
+ * all volatile and lie spread over the whole of STEPPER_params: the tick
+ * copies the API's settings in ('flags', 'decel_at', a new 'to_go') and
+ * publishes the interrupt's progress ('phase', 'to_go', the start of the
+ * ramp down) back to STEPPER_params, so the public view lags by at most a
+ * tick. */
+typedef struct MOTOR_TYPE {
+
+	/* Compare interrupt. */
+	uint8_t flags;		// M_xxx.
+	uint8_t phase;		// Coil phase; DDS engine: phase seen on the last tick.
+	uint16_t period;	// Timer1 counts per step; 0 while not stepping.
+	uint16_t last;		// Timer1 count of the last step.
+	uint16_t to_go;		// Steps left in a step move.
+	uint16_t decel_at;	// 'to_go' at which the ramp down starts.
+	int8_t steps;		// Net steps for STEPENG_take_steps().
+	uint8_t stepped;	// Stepped since the last tick.
+	uint16_t count;		// Steps since STEPENG_set_triggers().
+	uint16_t trig_at;	// 'count' of the next trigger.
+	uint8_t trig_pos;	// Its index in 'triggers'.
+
+	/* Tick only. */
+	int16_t speed;		// Speed 'period' was worked out for.
+	uint16_t pub_steps;	// nSteps as last published.
+	uint8_t pwm_ticks;	// Low power: ticks until the coils go off; 0: idle.
+	uint8_t pwm_off;	// Low power: braking coils off this tick.
+
+} MOTOR;
+
+/* MOTOR flags. */
+#define M_FWD		0x01	// Direction forward.
+#define M_STEP		0x02	// Step mode: count 'to_go' down.
+#define M_RAMP		0x04	// The step move ramps down (API acceleration).
+#define M_PENDING	0x08	// The step move is ending: ramp down begun.
+#define M_NEW		0x10	// M_PENDING not yet published.
+
+/* Velocity control of one wheel.  Speeds are kept in 1/1024 steps/s, so
+ * that one tick's change at A steps/s^2 is about A units. */
+typedef struct VELOCITY_TYPE {
+
+	int32_t speed;		// Current speed, negative in reverse.
+	int32_t target;
+	uint16_t accel;		// Units per tick away from 0; 0: no ramp.
+	uint16_t decel;		// Units per tick towards 0; 0: no ramp.
+	uint8_t active;
+
+} VELOCITY;
+
+#define VEL_SHIFT	10
+
+static STEPENG engine;
+static MOTOR motors[ 2 ];
+static uint8_t coils;		// Timer1 engine: coil pattern, PORTC bits 2..7.
+static VELOCITY vel[ 2 ];
+
+static STEPENG_LOAD load;
+static uint16_t load_mark;	// TCNT1 at the start of the last STEPENG_clk().
+
+static STEPENG_TRIGGER triggers[ STEPENG_MAX_TRIGGERS ];
+static uint8_t n_triggers;
+static volatile uint16_t events;
+
+/* STEPENG_watch_step(). */
+#define WATCH_OFF	0
+#define WATCH_ON	1		// Waiting for a step.
+#define WATCH_SEEN	2		// 'watch_mark' holds it.
+
+static volatile uint8_t watch;
+static volatile uint16_t watch_mark;
+
+/* A step was taken, by the ISR or tick running this: stamp it if one is
+ * awaited. */
+static void stamp( void )
+{
+	if( watch == WATCH_ON )
+	{
+		watch_mark = TICK_mark();
+		watch = WATCH_SEEN;
+	}
+}
+
+/* ----------------------------------------------------------------------- */
+/* Step triggers, both engines. */
+
+/* Point motor 'w' at its first trigger from table entry 'i' on that is
+ * still ahead of its count.  With none left 'trig_at' is set a full turn
+ * of the count behind, where it is reached only after 65535 more steps and
+ * then finds nothing. */
+static void seek( uint8_t w, uint8_t i )
+{
+	MOTOR *pM = &motors[ w ];
+
+	while( i < n_triggers &&
+		   ( triggers[ i ].motor != w || triggers[ i ].step <= pM->count ) )
+		i++;
+
+	pM->trig_pos = i;
+	pM->trig_at = ( i < n_triggers ) ? triggers[ i ].step : pM->count - 1;
+}
+
+/* Motor 'w''s count has reached 'trig_at': carry out the triggers for this
+ * step and move on to the next. */
+static void trigger( uint8_t w )
+{
+	MOTOR *pM = &motors[ w ];
+	const STEPENG_TRIGGER *pT;
+	uint8_t i;
+
+	for( i = pM->trig_pos; i < n_triggers; i++ )
+	{
+		pT = &triggers[ i ];
+
+		if( pT->motor != w )
+			continue;
+		if( pT->step != pM->count )
+			break;
+
+		switch( pT->action )
+		{
+			case STEPENG_TRIG_FLAG:		*pT->pFlag = 1;			break;
+			case STEPENG_TRIG_EVENT:	events |= pT->arg;		break;
+			case STEPENG_TRIG_NEXT_SEG:	MOTION_next();			break;
+			case STEPENG_TRIG_BEEP:		SPKR_beep( pT->arg );	break;
+		}
+	}
+
+	seek( w, i );
+}
+
+/* ----------------------------------------------------------------------- */
+/* Timer1 engine, compare interrupts. */
+
+/* Stop timing motor 'w''s steps. */
+static void stop( uint8_t w )
+{
+	TIMSK1 &= ~OCIE_BIT( w );
+	motors[ w ].period = 0;
+	motors[ w ].speed = 0;
+}
+
+/* Take motor 'w''s step that was due at OCR( w ) and set the next one. */
+static void step( uint8_t w )
+{
+	MOTOR *pM = &motors[ w ];
+	uint8_t flags = pM->flags;
+	uint8_t phase = pM->phase;
+	uint16_t to_go;
+
+	/* A step move without a ramp ends on its last step; the tick stops the
+	 * motor and reports it. */
+	if( ( flags & ( M_PENDING | M_RAMP ) ) == M_PENDING )
+	{
+		stop( w );
+		return;
+	}
+
+	coils = ( coils & ~coil_mask[ w ] ) | LUT( w )[ phase ];
+	PORTC = ( PORTC & 3 ) | coils;
+
+	if( flags & M_FWD )
+	{
+		phase++;
+		pM->steps++;
+	}
+	else
+	{
+		phase--;
+		pM->steps--;
+	}
+
+	pM->phase = phase & 3;
+	pM->stepped = 1;
+	stamp();
+
+	if( ++pM->count == pM->trig_at )
+		trigger( w );
+
+	/* Step mode as the API counts it: the ramp down starts with
+	 * 'decel_begin' steps to go. */
+	if( flags & M_STEP )
+	{
+		to_go = pM->to_go;
+		if( to_go )
+			pM->to_go = --to_go;
+
+		if( !( flags & M_PENDING ) && to_go == pM->decel_at )
+			pM->flags = flags | M_PENDING | M_NEW;
+	}
+
+	/* Time from when the step was due, not from now, so interrupt latency
+	 * does not add up. */
+	pM->last = OCR( w );
+	OCR( w ) = pM->last + pM->period;
+}
+
+/* Charge a compare interrupt that started at Timer1 count 't0' to the
+ * load. */
+static void account( uint16_t t0 )
+{
+	load.step += (uint16_t)( TCNT1 - t0 );
+	load.steps++;
+}
+
+static void STEPENG_left_isr( void )
+{
+	uint16_t t0 = TCNT1;
+
+	step( STEPPER_LEFT );
+	account( t0 );
+}
+
+static void STEPENG_right_isr( void )
+{
+	uint16_t t0 = TCNT1;
+
+	step( STEPPER_RIGHT );
+	account( t0 );
+}
+
+/* ----------------------------------------------------------------------- */
+/* Timer1 engine, tick. */
+
+/* Motor 'w''s speed has changed to 'speed': time its next step from the
+ * last one at the new rate, or take it right away if that time has
+ * passed.  A stopped motor takes its first step a period from now. */
+static void schedule( uint8_t w, int16_t speed )
+{
+	MOTOR *pM = &motors[ w ];
+	uint16_t now = TCNT1;
+	uint16_t period = ( speed < STEPENG_MIN_SPEED ) ? 0xFFFF : TIMER_HZ / speed;
+	uint8_t start = ( pM->period == 0 );
+
+	pM->speed = speed;
+
+	if( start )
+		pM->last = now;
+	else if( TIFR1 & OCF_BIT( w ) )
+	{
+		/* A step is already due; it will pick up the new period. */
+		pM->period = period;
+		return;
+	}
+
+	if( (uint16_t)( now - pM->last ) >= period - MARGIN )
+		OCR( w ) = now + MARGIN;
+	else
+		OCR( w ) = pM->last + period;
+
+	pM->period = period;
+
+	if( start )
+	{
+		TIFR1 = OCF_BIT( w );	// Drop a match on the old compare value.
+		TIMSK1 |= OCIE_BIT( w );
+	}
+}
+
+/* Low power mode as the API runs it: a braking motor's coils are on every
+ * other tick, and below 51 steps/s a motor's coils go off speed * 3/4 ticks
+ * after each step. */
+static void pwm( uint8_t w, int16_t speed, uint8_t braking )
+{
+	MOTOR *pM = &motors[ w ];
+
+	if( braking )
+	{
+		pM->pwm_off ^= 1;
+		if( pM->pwm_off )
+			coils &= ~coil_mask[ w ];
+	}
+	else if( speed < 51 )
+	{
+		if( pM->stepped )
+			pM->pwm_ticks = ( speed * 96 ) >> 7;
+		else if( pM->pwm_ticks && --pM->pwm_ticks == 0 )
+			coils &= ~coil_mask[ w ];
+	}
+}
+
+/* Copy the API's settings for motor 'w' in and publish the compare
+ * interrupt's progress.  The API writes 'nSteps' only to start a move or
+ * to stop, so a count other than the one last published is the API's, and
+ * ends any ramp down the interrupt had begun. */
+static void sync( uint8_t w )
+{
+	MOTOR *pM = &motors[ w ];
+	uint16_t n = STEPENG_SIDE( nSteps, w );
+	uint8_t flags = pM->flags & ( M_PENDING | M_NEW );
+
+	if( n != pM->pub_steps )
+	{
+		pM->to_go = n;
+		flags = 0;
+	}
+	else if( flags & M_NEW )
+	{
+		STEPENG_SIDE( step_speed, w ) = 0;
+		STEPENG_SIDE( pending, w ) = 1;
+		flags &= ~M_NEW;
+	}
+	else if( !STEPENG_SIDE( pending, w ) )
+		flags = 0;
+
+	if( STEPENG_SIDE( dir_mode, w ) == STEPPER_FWD )
+		flags |= M_FWD;
+	if( STEPENG_SIDE( op_mode, w ) == STEPPER_STEP_MODE )
+		flags |= M_STEP;
+	if( STEPENG_SIDE( step_accel, w ) )
+		flags |= M_RAMP;
+
+	pM->flags = flags;
+	pM->decel_at = STEPENG_SIDE( decel_begin, w );
+
+	STEPENG_SIDE( nSteps, w ) = pM->to_go;
+	STEPENG_SIDE( phase, w ) = pM->phase;
+}
+
+/* The tick's part of motor 'w', as STEPPER_clk() does it, working on local
+ * copies of the STEPPER_params fields. */
+static void motor_clk( uint8_t w )
+{
+	MOTOR *pM = &motors[ w ];
+	int16_t speed = STEPENG_SIDE( curr_speed, w );
+	int16_t target = STEPENG_SIDE( step_speed, w );
+	uint16_t accel = STEPENG_SIDE( step_accel, w );
+	uint16_t dds;
+	uint8_t braking = 0;
+
+	/* Ramp towards the set speed by one step/s per 1000 / accel ticks. */
+	if( accel )
+	{
+		dds = STEPENG_SIDE( dds_accel, w ) + accel;
+
+		if( dds >= 1000 )
+		{
+			dds -= 1000;
+
+			if( speed < target )
+				speed++;
+			else if( speed > target )
+				speed--;
+		}
+
+		STEPENG_SIDE( dds_accel, w ) = dds;
+	}
+	else
+		speed = target;
+
+	STEPENG_SIDE( curr_speed, w ) = speed;
+
+	if( STEPPER_params.busy_status == STEPPER_BUSY )
+		return;
+
+	sync( w );
+
+	if( STEPENG_SIDE( brake, w ) )
+	{
+		/* Hold the coils of the current phase. */
+		stop( w );
+		coils = ( coils & ~coil_mask[ w ] ) | LUT( w )[ pM->phase ];
+		STEPENG_SIDE( astate, w ) = STEPPER_BRAKING;
+		STEPENG_SIDE( curr_speed, w ) = 0;
+		braking = 1;
+	}
+	else if( speed == 0 )
+	{
+		stop( w );
+		coils &= ~coil_mask[ w ];
+		STEPENG_SIDE( astate, w ) = STEPPER_STOPPED;
+
+		/* End of a step move. */
+		if( STEPENG_SIDE( pending, w ) )
+		{
+			STEPPER_stop( w, STEPENG_SIDE( stop_mode, w ) );
+
+			if( STEPPER_params.pNotify )
+				( (volatile STEPPER_FLAG *) STEPPER_params.pNotify )[ w ] = 1;
+
+			STEPENG_SIDE( pending, w ) = 0;
+			pM->flags &= ~M_PENDING;
+		}
+	}
+	else
+	{
+		if( speed != pM->speed )
+			schedule( w, speed );
+		STEPENG_SIDE( astate, w ) = STEPPER_RUNNING;
+	}
+
+	if( STEPPER_params.power_mode == STEPPER_PWR_LOW )
+		pwm( w, speed, braking );
+
+	/* STEPPER_stop() may have set a new count. */
+	pM->to_go = pM->pub_steps = STEPENG_SIDE( nSteps, w );
+	pM->stepped = 0;
+}
+
+/* Timer1 engine tick. */
+static void timer_clk( void )
+{
+	motor_clk( STEPPER_LEFT );
+	motor_clk( STEPPER_RIGHT );
+
+	PORTC = ( PORTC & 3 ) | coils;
+}
+
+/* ----------------------------------------------------------------------- */
+/* DDS engine. */
+
+/* A step moves the phase one place, and at 400 steps/s there is at most
+ * one step per tick. */
+static void tally( uint8_t w )
+{
+	MOTOR *pM = &motors[ w ];
+	uint8_t now = STEPENG_SIDE( phase, w );
+	uint8_t delta = ( now - pM->phase ) & 3;
+
+	pM->phase = now;
+
+	if( delta == 1 )
+		pM->steps++;
+	else if( delta == 3 )
+		pM->steps--;
+	else
+		return;
+
+	stamp();
+
+	if( ++pM->count == pM->trig_at )
+		trigger( w );
+}
+
+/* ----------------------------------------------------------------------- */
+/* Velocity control, both engines. */
+
+/* Move wheel 'w''s speed one tick towards its target and hand it to the
+ * engine as a speed and direction. */
+static void slew( uint8_t w )
+{
+	VELOCITY *pV = &vel[ w ];
+	int32_t v = pV->speed;
+	int32_t t = pV->target;
+	int32_t limit;
+	uint16_t rate;
+
+	if( !pV->active || STEPPER_params.busy_status == STEPPER_BUSY )
+		return;
+
+	if( v != t )
+	{
+		/* Away from 0 at 'accel'; towards 0, and down to 0 before a
+		 * reversal, at 'decel'. */
+		if( ( v >= 0 && t > v ) || ( v <= 0 && t < v ) )
+		{
+			rate = pV->accel;
+			limit = t;
+		}
+		else
+		{
+			rate = pV->decel;
+			limit = ( ( v > 0 && t < 0 ) || ( v < 0 && t > 0 ) ) ? 0 : t;
+		}
+
+		if( rate == 0 )
+			v = t;
+		else if( t > v )
+			v = ( v + rate < limit ) ? v + rate : limit;
+		else
+			v = ( v - rate > limit ) ? v - rate : limit;
+
+		pV->speed = v;
+	}
+
+	if( v < 0 )
+	{
+		STEPENG_SIDE( dir_mode, w ) = STEPPER_REV;
+		STEPENG_SIDE( step_speed, w ) = -v >> VEL_SHIFT;
+	}
+	else
+	{
+		if( v > 0 )
+			STEPENG_SIDE( dir_mode, w ) = STEPPER_FWD;
+		STEPENG_SIDE( step_speed, w ) = v >> VEL_SHIFT;
+	}
+}
+
+/* ----------------------------------------------------------------------- */
+
+SUBSYS_OPENSTAT STEPENG_open( STEPENG which )
+{
+	SUBSYS_OPENSTAT stat = STEPPER_open();
+
+	if( stat.state != SUBSYS_OPEN )
+		return stat;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		motors[ STEPPER_LEFT ].phase = STEPPER_params.phase.left;
+		motors[ STEPPER_RIGHT ].phase = STEPPER_params.phase.right;
+
+		/* Timer1 runs free for either engine: it times the load. */
+		PRR &= ~( 1 << PRTIM1 );
+		TCCR1A = 0;								// Normal mode: free-running.
+		TCCR1B = ( 1 << CS11 ) | ( 1 << CS10 );	// F_CPU / 64.
+
+		load_mark = TCNT1;
+
+		if( which == STEPENG_TIMER )
+		{
+			stop( STEPPER_LEFT );
+			stop( STEPPER_RIGHT );
+			coils = 0;
+
+			ISR_attach( ISR_TIMER1_COMPA_VECT, STEPENG_left_isr );
+			ISR_attach( ISR_TIMER1_COMPB_VECT, STEPENG_right_isr );
+		}
+
+		engine = which;
+	}
+
+	return stat;
+}
+
+STEPENG STEPENG_get( void )
+{
+	return engine;
+}
+
+void STEPENG_clk( void )
+{
+	uint16_t now = TCNT1;
+
+	load.elapsed += (uint16_t)( now - load_mark );
+	load_mark = now;
+
+	slew( STEPPER_LEFT );
+	slew( STEPPER_RIGHT );
+
+	if( engine == STEPENG_DDS )
+	{
+		STEPPER_clk();
+		tally( STEPPER_LEFT );
+		tally( STEPPER_RIGHT );
+	}
+	else if( SYS_get_state( SUBSYS_STEPPER ) != SUBSYS_OPEN )
+	{
+		stop( STEPPER_LEFT );
+		stop( STEPPER_RIGHT );
+	}
+	else
+		timer_clk();
+
+	load.clk += (uint16_t)( TCNT1 - now );
+}
+
+void STEPENG_set_speed( STEPPER_ID which, uint16_t nStepsPerSec )
+{
+	if( engine == STEPENG_DDS )
+	{
+		STEPPER_set_speed( which, nStepsPerSec );
+		return;
+	}
+
+	if( nStepsPerSec > STEPENG_MAX_SPEED )
+		nStepsPerSec = STEPENG_MAX_SPEED;
+
+	STEPPER_params.busy_status = STEPPER_BUSY;
+
+	if( which != STEPPER_RIGHT )
+		STEPPER_params.step_speed.left = nStepsPerSec;
+	if( which != STEPPER_LEFT )
+		STEPPER_params.step_speed.right = nStepsPerSec;
+
+	STEPPER_params.busy_status = STEPPER_NOT_BUSY;
+}
+
+/* Fastest speed of the engine in use. */
+static uint16_t max_speed( void )
+{
+	return ( engine == STEPENG_DDS ) ? STEPENG_DDS_MAX_SPEED : STEPENG_MAX_SPEED;
+}
+
+void STEPENG_tick_speed( STEPPER_ID w, uint16_t speed )
+{
+	/* The engine ends a step move by setting its speed to 0 (with the
+	 * Timer1 engine the interrupt flags it first, for the tick to see). */
+	if( STEPENG_SIDE( pending, w ) || ( motors[ w ].flags & M_PENDING ) )
+		return;
+
+	if( speed > max_speed() )
+		speed = max_speed();
+
+	STEPENG_SIDE( step_speed, w ) = speed;
+}
+
+void STEPENG_tick_move( STEPPER_ID w, STEPPER_DIR dir, uint16_t steps,
+	uint16_t speed, STEPPER_BRKMODE stop_mode )
+{
+	MOTOR *pM = &motors[ w ];
+
+	if( speed > max_speed() )
+		speed = max_speed();
+
+	/* What STEPPER_move() sets up for a move without acceleration. */
+	STEPENG_SIDE( op_mode, w ) =
+		steps ? STEPPER_STEP_MODE : STEPPER_NORMAL_MODE;
+	STEPENG_SIDE( dir_mode, w ) = dir;
+	STEPENG_SIDE( step_accel, w ) = 0;
+	STEPENG_SIDE( decel_begin, w ) = 0;
+	STEPENG_SIDE( stop_mode, w ) = stop_mode;
+	STEPENG_SIDE( nSteps, w ) = steps;
+	STEPENG_SIDE( pending, w ) = 0;
+	( (volatile STEPPER_FLAG *) &step_done )[ w ] = 0;
+	STEPPER_params.pNotify = &step_done;
+	STEPENG_SIDE( step_speed, w ) = speed;
+	STEPENG_SIDE( brake, w ) = STEPPER_BRK_OFF;
+
+	/* The Timer1 engine's copy too, so the interrupt counts the new move
+	 * from its first step rather than from the next sync(). */
+	pM->to_go = pM->pub_steps = steps;
+	pM->decel_at = 0;
+	pM->flags = ( ( dir == STEPPER_FWD ) ? M_FWD : 0 ) | ( steps ? M_STEP : 0 );
+}
+
+void STEPENG_tick_unbrake( STEPPER_ID w )
+{
+	STEPENG_SIDE( step_speed, w ) = 0;
+	STEPENG_SIDE( nSteps, w ) = 0;
+	STEPENG_SIDE( brake, w ) = STEPPER_BRK_OFF;
+}
+
+void STEPENG_set_velocity( STEPPER_ID which, int16_t speed )
+{
+	int16_t max = ( engine == STEPENG_DDS ) ? STEPENG_DDS_MAX_SPEED : STEPENG_MAX_SPEED;
+	uint8_t w;
+
+	if( speed > max )
+		speed = max;
+	else if( speed < -max )
+		speed = -max;
+
+	/* Take over the wheel; the tick drives its speed from here on. */
+	STEPPER_set_mode( which, STEPPER_NORMAL_MODE );
+	STEPPER_set_accel( which, 0 );
+	STEPPER_go( which );
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		for( w = STEPPER_LEFT; w <= STEPPER_RIGHT; w++ )
+		{
+			if( which != STEPPER_BOTH && which != w )
+				continue;
+
+			if( !vel[ w ].active )
+			{
+				/* Start from the speed the wheel has now. */
+				vel[ w ].speed =
+					(int32_t) STEPENG_SIDE( curr_speed, w ) << VEL_SHIFT;
+				if( STEPENG_SIDE( dir_mode, w ) == STEPPER_REV )
+					vel[ w ].speed = -vel[ w ].speed;
+
+				STEPENG_SIDE( pending, w ) = 0;
+				motors[ w ].flags &= ~( M_PENDING | M_NEW );
+				vel[ w ].active = 1;
+			}
+
+			vel[ w ].target = (int32_t) speed << VEL_SHIFT;
+		}
+	}
+}
+
+void STEPENG_set_ramp( STEPPER_ID which, uint16_t accel, uint16_t decel )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		if( which != STEPPER_RIGHT )
+		{
+			vel[ STEPPER_LEFT ].accel = accel;
+			vel[ STEPPER_LEFT ].decel = decel;
+		}
+		if( which != STEPPER_LEFT )
+		{
+			vel[ STEPPER_RIGHT ].accel = accel;
+			vel[ STEPPER_RIGHT ].decel = decel;
+		}
+	}
+}
+
+void STEPENG_release( STEPPER_ID which )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		if( which != STEPPER_RIGHT )
+			vel[ STEPPER_LEFT ].active = 0;
+		if( which != STEPPER_LEFT )
+			vel[ STEPPER_RIGHT ].active = 0;
+	}
+}
+
+uint8_t STEPENG_slewing( STEPPER_ID w )
+{
+	uint8_t slewing;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		slewing = vel[ w ].active && vel[ w ].speed != vel[ w ].target;
+	}
+
+	return slewing;
+}
+
+uint8_t STEPENG_set_triggers( const STEPENG_TRIGGER *pTable, uint8_t n )
+{
+	uint8_t ok = ( n <= STEPENG_MAX_TRIGGERS );
+	uint8_t i;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		n_triggers = ok ? n : 0;
+		for( i = 0; i < n_triggers; i++ )
+			triggers[ i ] = pTable[ i ];
+
+		motors[ STEPPER_LEFT ].count = 0;
+		motors[ STEPPER_RIGHT ].count = 0;
+		seek( STEPPER_LEFT, 0 );
+		seek( STEPPER_RIGHT, 0 );
+	}
+
+	return ok;
+}
+
+void STEPENG_watch_step( uint8_t on )
+{
+	watch = on ? WATCH_ON : WATCH_OFF;
+}
+
+uint8_t STEPENG_step_seen( uint16_t *pMark )
+{
+	uint8_t seen;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		seen = ( watch == WATCH_SEEN );
+		if( seen )
+		{
+			*pMark = watch_mark;
+			watch = WATCH_OFF;
+		}
+	}
+
+	return seen;
+}
+
+uint16_t STEPENG_take_events( void )
+{
+	uint16_t posted;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		posted = events;
+		events = 0;
+	}
+
+	return posted;
+}
+
+void STEPENG_get_load( STEPENG_LOAD *pLoad )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		*pLoad = load;
+	}
+}
+
+void STEPENG_take_steps( int8_t *pLeft, int8_t *pRight )
+{
+	*pLeft = motors[ STEPPER_LEFT ].steps;
+	*pRight = motors[ STEPPER_RIGHT ].steps;
+
+	motors[ STEPPER_LEFT ].steps = 0;
+	motors[ STEPPER_RIGHT ].steps = 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+#if STEPENG_BENCH
+
+static STEPPER_PARAMS bench_params;
+static MOTOR bench_motors[ 2 ];
+static uint8_t bench_coils;
+
+static void bench_nop( void )
+{
+}
+
+/* CPU cycles per call of 'fn' on the bench move, loop included.  Timer1
+ * must be counting at F_CPU. */
+static uint16_t bench_run( void ( *fn )( void ) )
+{
+	uint8_t timsk = TIMSK1;
+	uint16_t t0, t1;
+	uint8_t i, w;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		bench_params = STEPPER_params;
+		bench_motors[ 0 ] = motors[ 0 ];
+		bench_motors[ 1 ] = motors[ 1 ];
+		bench_coils = coils;
+
+		/* Half way up the ramp of a 1000-step move at 200 steps/s. */
+		for( w = STEPPER_LEFT; w <= STEPPER_RIGHT; w++ )
+		{
+			STEPENG_SIDE( op_mode, w ) = STEPPER_STEP_MODE;
+			STEPENG_SIDE( dir_mode, w ) = STEPPER_FWD;
+			STEPENG_SIDE( brake, w ) = STEPPER_BRK_OFF;
+			STEPENG_SIDE( step_speed, w ) = 200;
+			STEPENG_SIDE( curr_speed, w ) = 100;
+			STEPENG_SIDE( step_accel, w ) = 400;
+			STEPENG_SIDE( nSteps, w ) = 1000;
+			STEPENG_SIDE( decel_begin, w ) = 50;
+			STEPENG_SIDE( pending, w ) = 0;
+			motors[ w ].trig_at = motors[ w ].count - 1;	// No triggers.
+		}
+		STEPPER_params.power_mode = STEPPER_PWR_HIGH;
+		STEPPER_params.busy_status = STEPPER_NOT_BUSY;
+
+		t0 = TCNT1;
+		for( i = 0; i < STEPENG_BENCH_RUNS; i++ )
+			fn();
+		t1 = TCNT1;
+
+		STEPPER_params = bench_params;
+		motors[ 0 ] = bench_motors[ 0 ];
+		motors[ 1 ] = bench_motors[ 1 ];
+		coils = bench_coils;
+		PORTC = ( PORTC & 3 ) | coils;
+
+		TIMSK1 = timsk;
+		TIFR1 = ( 1 << OCF1A ) | ( 1 << OCF1B );
+	}
+
+	return (uint16_t)( t1 - t0 ) / STEPENG_BENCH_RUNS;
+}
+
+void STEPENG_bench( STEPENG_BENCH_RESULT *pResult )
+{
+	uint8_t prr = PRR;
+	uint8_t tccr = TCCR1B;
+	uint16_t loop;
+	STEPENG_LOAD saved;
+
+	pResult->ran = ( STEPPER_params.curr_speed.left == 0 &&
+					 STEPPER_params.curr_speed.right == 0 );
+	if( !pResult->ran )
+		return;
+
+	STEPENG_get_load( &saved );
+
+	PRR &= ~( 1 << PRTIM1 );
+	TCCR1B = ( 1 << CS10 );		// F_CPU.
+
+	loop = bench_run( bench_nop );
+	pResult->api_clk = bench_run( STEPPER_clk ) - loop;
+	pResult->timer_clk = bench_run( timer_clk ) - loop;
+	pResult->timer_step = bench_run( STEPENG_left_isr ) - loop;
+
+	/* Leave the load as it was, less the time of the bench itself. */
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		TCCR1B = tccr;
+		PRR = prr;
+		load = saved;
+		load_mark = TCNT1;
+	}
+}
+
+#endif /* STEPENG_BENCH */
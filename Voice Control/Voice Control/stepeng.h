@@ -0,0 +1,230 @@
+/*
+ * stepeng.h
+ *
+ * Stepper engine selection.  The API's engine, STEPPER_clk(), polls a DDS
+ * accumulator for each motor on every system tick, so steps can only fall
+ * on tick boundaries: the step rate is capped below the tick rate (the API
+ * clamps it to 400 steps/s), each step lands up to a tick late, and the
+ * clock costs the same every tick whether a step is due or not.
+ *
+ * The Timer1 engine instead sets the compare registers of a free-running
+ * Timer1 to the exact time of each motor's next step (OCR1A for the left
+ * motor, OCR1B for the right), and the compare interrupt takes the step and
+ * sets the following one.  Steps land on a 3.2 us grid, a motor costs
+ * nothing between steps, and speeds up to STEPENG_MAX_SPEED are possible.
+ * The tick still ramps the speeds, handles braking and stopping, and runs
+ * the low power mode, all as STEPPER_clk() does, and it reschedules a motor
+ * only when its speed has changed.
+ *
+ * The compare interrupt does not touch STEPPER_params: it works on a
+ * compact state per motor, which the tick loads with the API's settings
+ * and whose progress (phase, steps left, start of the ramp down) the tick
+ * writes back.  STEPPER_params therefore stays usable as before but may be
+ * up to a tick behind the motors.  The tick itself reads each field it
+ * needs once.
+ *
+ * Either way the API's STEPPER_xxx() functions are used as before.  Only
+ * STEPENG_set_speed() goes past the API's 400 steps/s limit.
+ *
+ * On top of either engine a free-running wheel can be put under velocity
+ * control: STEPENG_set_velocity() gives it a signed target speed and the
+ * tick slews the speed towards it at the rates set with STEPENG_set_ramp(),
+ * reversing the direction when the speed passes through 0.  A new target
+ * takes over from the speed the wheel has at the time, so changing or
+ * repeating a command never restarts the ramp.
+ *
+ * Both engines take full steps only.  Each motor is driven through three
+ * PORTC lines, and the only drive codes known for them are the four phases
+ * of Motor_L_LUT/Motor_R_LUT (0x18, 0x0C, 0x04, 0x10 on PC2..PC4 for the
+ * left motor) and 0 for coils off.  Half steps and wave drive need codes
+ * that leave one winding energized; the driver's wiring and its response
+ * to the other codes are not documented, and three lines give at most 6
+ * distinct positions to the cycle, so no such table is written here.  With
+ * a single mode there are no pull-in speeds to compare either.  Smoother
+ * slow running comes from the Timer1 engine's exact step spacing instead.
+ *
+ * Actions can be tied to step counts with a trigger table instead of the
+ * per-step callbacks of STEPPER_move(): each entry names a motor, a step
+ * number and what to do when that step is taken (set a flag, post event
+ * bits, end the MOTION segment in progress, or start or stop a beep).  The
+ * engine compares each step's count with the next entry due for that
+ * motor, so a step without a trigger costs one 16-bit compare.  The Timer1
+ * engine fires a trigger on its step; the DDS engine in the tick that sees
+ * the step.
+ *
+ * The stepper load is measured on either engine: STEPENG_get_load() gives
+ * the time spent in the stepper clock and in the compare interrupts
+ * against the time elapsed, all in Timer1 counts.  Each call is timed to
+ * whole counts (64 cycles) between two reads of TCNT1, so single figures
+ * are coarse but the sums over many calls are not; the interrupt entry
+ * and exit and the tick's own overhead are outside the figures.
+ *
+ * Both engines run Timer1 free at F_CPU / 64 (the Timer1 engine also uses
+ * its compares), so the speaker tones (SPKR_open()) and the stopwatch
+ * (STOPWATCH_open()) cannot be used with either.  Beeps do not use
+ * Timer1.
+ */
+#ifndef STEPENG_H_
+#define STEPENG_H_
+
+#include <stdint.h>
+#include "capi324v221.h"
+
+/* One motor's field of a STEPPER_params left/right pair, 'w' being a
+ * STEPPER_ID (not STEPPER_BOTH). */
+#define STEPENG_SIDE( field, w ) \
+	( ( (volatile __typeof__( STEPPER_params.field.left ) *) &STEPPER_params.field )[ w ] )
+
+typedef enum STEPENG_TYPE {
+
+	STEPENG_DDS = 0,	// The API's STEPPER_clk().
+	STEPENG_TIMER		// Timer1 compare scheduling.
+
+} STEPENG;
+
+/* Fastest speed on the Timer1 engine, steps/s. */
+#define STEPENG_MAX_SPEED	1000
+
+/* Fastest speed on the DDS engine (the STEPPER_set_speed() clamp). */
+#define STEPENG_DDS_MAX_SPEED	400
+
+/* The slowest step rate Timer1 can time is 312500 / 65535 = 4.8 steps/s;
+ * slower speeds step at that rate on the Timer1 engine. */
+#define STEPENG_MIN_SPEED	5
+
+/* Set to 1 to build STEPENG_bench() and answer PROTO_OP_GET_STEP_BENCH. */
+#ifndef STEPENG_BENCH
+	#define STEPENG_BENCH		0
+#endif
+
+#define STEPENG_BENCH_RUNS	32		// Calls per measurement.
+
+typedef struct STEPENG_BENCH_RESULT_TYPE {
+
+	uint16_t api_clk;		// CPU cycles per STEPPER_clk().
+	uint16_t timer_clk;		// CPU cycles per Timer1 engine tick.
+	uint16_t timer_step;	// CPU cycles per Timer1 engine step, handler only.
+	uint8_t ran;			// 0: not run, a wheel was moving.
+
+} STEPENG_BENCH_RESULT;
+
+/* Stepper load since STEPENG_open(), in Timer1 counts (3.2 us). */
+typedef struct STEPENG_LOAD_TYPE {
+
+	uint32_t clk;			// In STEPENG_clk().
+	uint32_t step;			// In the compare interrupts (Timer1 engine).
+	uint32_t elapsed;		// Up to the last STEPENG_clk(); wraps after ~3.8 h.
+	uint32_t steps;			// Compare interrupts taken.
+
+} STEPENG_LOAD;
+
+/* Most entries in a trigger table. */
+#define STEPENG_MAX_TRIGGERS	8
+
+typedef enum STEPENG_ACTION_TYPE {
+
+	STEPENG_TRIG_FLAG = 0,	// Set '*pFlag' to 1.
+	STEPENG_TRIG_EVENT,		// Post event bits 'arg' (STEPENG_take_events()).
+	STEPENG_TRIG_NEXT_SEG,	// End the MOTION segment in progress (MOTION_next()).
+	STEPENG_TRIG_BEEP		// SPKR_beep( 'arg' ); 0 stops the beep.
+
+} STEPENG_ACTION;
+
+typedef struct STEPENG_TRIGGER_TYPE {
+
+	uint16_t step;				// Fires on this step since arming, 1 the first.
+	uint8_t motor;				// STEPPER_LEFT or STEPPER_RIGHT.
+	uint8_t action;				// STEPENG_ACTION.
+	uint16_t arg;
+	volatile uint8_t *pFlag;	// STEPENG_TRIG_FLAG only.
+
+} STEPENG_TRIGGER;
+
+/* Open the stepper module with STEPPER_open() and select 'engine'.  Call
+ * in place of STEPPER_open(). */
+SUBSYS_OPENSTAT STEPENG_open( STEPENG engine );
+
+/* The engine selected at open. */
+STEPENG STEPENG_get( void );
+
+/* Stepper clock: called by the system tick in place of STEPPER_clk(). */
+void STEPENG_clk( void );
+
+/* STEPPER_set_speed() with the limit of the engine in use. */
+void STEPENG_set_speed( STEPPER_ID which, uint16_t nStepsPerSec );
+
+/* For code running in the system tick (a TICK_attach() hook), which runs
+ * after the stepper clock and so between its updates.  Unlike the
+ * STEPPER_xxx() functions they leave busy_status alone, which a main-loop
+ * STEPPER_xxx() call may be holding: call them only while it is clear. */
+
+/* Set wheel 'w''s speed, clamped to the engine's limit.  A step move that
+ * is ending keeps the speed 0 its engine gave it, so the speed is left
+ * alone then. */
+void STEPENG_tick_speed( STEPPER_ID w, uint16_t speed );
+
+/* Start wheel 'w' at 'speed' without API ramping: 'steps' steps in step
+ * mode, then stop as 'stop_mode' says and report through step_done, or
+ * with 'steps' 0 free-running. */
+void STEPENG_tick_move( STEPPER_ID w, STEPPER_DIR dir, uint16_t steps,
+	uint16_t speed, STEPPER_BRKMODE stop_mode );
+
+/* Release stopped wheel 'w''s brake, which de-energizes its coils, as
+ * STEPPER_stop( w, STEPPER_BRK_OFF ) does. */
+void STEPENG_tick_unbrake( STEPPER_ID w );
+
+/* Put 'which' under velocity control, if it is not already, and slew it
+ * to 'speed' steps/s (negative: reverse).  The wheel is switched to
+ * free-running mode, its brake released and its API acceleration cleared;
+ * a step move in progress is abandoned without notice. */
+void STEPENG_set_velocity( STEPPER_ID which, int16_t speed );
+
+/* Slew rates for velocity control in steps/s^2: 'accel' away from 0,
+ * 'decel' towards it.  0 changes speed at once.  Initially 0. */
+void STEPENG_set_ramp( STEPPER_ID which, uint16_t accel, uint16_t decel );
+
+/* End velocity control of 'which'.  The wheel keeps its current speed and
+ * direction; call before handing it to STEPPER_xxx() functions. */
+void STEPENG_release( STEPPER_ID which );
+
+/* 1 while wheel 'w' (STEPPER_LEFT or STEPPER_RIGHT) is under velocity
+ * control and still slewing towards its target. */
+uint8_t STEPENG_slewing( STEPPER_ID w );
+
+/* Copy 'n' triggers from 'pTable' and start counting both motors' steps
+ * from 0.  Steps are counted in either direction.  Each motor's entries
+ * must be in order of 'step' (the two motors' may be mixed); an entry out
+ * of order never fires.  n = 0 clears the table.  Returns 0, and leaves the
+ * table empty, if 'n' is over STEPENG_MAX_TRIGGERS. */
+uint8_t STEPENG_set_triggers( const STEPENG_TRIGGER *pTable, uint8_t n );
+
+/* Event bits posted by STEPENG_TRIG_EVENT triggers since the last call. */
+uint16_t STEPENG_take_events( void );
+
+/* With 'on' non-zero, stamp the next step of either motor with
+ * TICK_mark() where it is taken: in the compare interrupt on the Timer1
+ * engine, in the tick that sees it on the DDS engine.  0 stops waiting. */
+void STEPENG_watch_step( uint8_t on );
+
+/* 1, with the stamp in '*pMark', once the step awaited has been taken;
+ * the watch then ends. */
+uint8_t STEPENG_step_seen( uint16_t *pMark );
+
+#if STEPENG_BENCH
+/* Time the API's STEPPER_clk() and the Timer1 engine's tick and step on
+ * the same ramping step move of both motors, with interrupts off and
+ * Timer1 counting CPU cycles.  Call with both wheels stopped: the coils
+ * are driven for the length of the bench only, and the stepper state and
+ * Timer1 are put back afterwards. */
+void STEPENG_bench( STEPENG_BENCH_RESULT *pResult );
+#endif
+
+/* Copy the load accounting into '*pLoad'.  The CPU share of the stepper
+ * engine is ( clk + step ) / elapsed. */
+void STEPENG_get_load( STEPENG_LOAD *pLoad );
+
+/* Net steps taken by each motor since the last call (negative: reverse).
+ * Call from the system tick (TICK_attach()) at least every 100 ticks. */
+void STEPENG_take_steps( int8_t *pLeft, int8_t *pRight );
+
+#endif /* STEPENG_H_ */
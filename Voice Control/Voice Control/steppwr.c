@@ -0,0 +1,115 @@
+/*
+ * steppwr.c
+ *
+ * Stepper power mode chosen from what the wheels are doing.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <util/atomic.h>
+#include "tick.h"
+#include "stepeng.h"
+#include "steppwr.h"
+
+/* Tick state, per wheel. */
+static int16_t last[ 2 ];			// Speed on the last tick.
+static uint8_t settle[ 2 ];			// Ticks of HIGH mode left after a ramp.
+static uint16_t idle[ 2 ];			// Ticks stopped braked, up to 'idle_off'.
+
+static uint16_t idle_low = STEPPWR_IDLE_LOW;
+static uint16_t idle_off = STEPPWR_IDLE_OFF;
+
+static STEPPWR_STATS stats;
+
+#if STEPPWR_SETTLE > 255
+	#error "STEPPWR_SETTLE must fit in 8 bits"
+#endif
+
+/* Update wheel 'w''s state.  Returns 1 if it wants HIGH mode. */
+static uint8_t wheel( uint8_t w )
+{
+	int16_t speed = STEPENG_SIDE( curr_speed, w );
+
+	/* Any change of speed, a start or stop at full speed included, counts
+	 * as a ramp. */
+	if( speed != last[ w ] || speed != STEPENG_SIDE( step_speed, w ) ||
+		STEPENG_slewing( w ) )
+	{
+		last[ w ] = speed;
+		settle[ w ] = STEPPWR_SETTLE;
+		idle[ w ] = 0;
+		return 1;
+	}
+
+	if( !STEPENG_SIDE( brake, w ) )
+	{
+		idle[ w ] = 0;
+	}
+	else if( idle[ w ] < 0xFFFF )
+	{
+		idle[ w ]++;
+
+		if( idle_off && idle[ w ] >= idle_off )
+		{
+			STEPENG_tick_unbrake( w );
+			stats.releases++;
+			idle[ w ] = 0;
+		}
+	}
+
+	if( settle[ w ] )
+	{
+		settle[ w ]--;
+		return 1;
+	}
+
+	/* LOW would switch a slow wheel's coils off between its steps. */
+	if( speed && speed < STEPPWR_LOW_MIN_SPEED )
+		return 1;
+
+	return STEPENG_SIDE( brake, w ) && idle[ w ] < idle_low;
+}
+
+/* Tick hook: runs after the stepper clock, so the mode chosen takes effect
+ * on the next tick. */
+static void STEPPWR_tick( void )
+{
+	uint8_t high;
+
+	if( STEPPER_params.busy_status == STEPPER_BUSY )
+		return;
+
+	high = wheel( STEPPER_LEFT );
+	high |= wheel( STEPPER_RIGHT );
+
+	STEPPER_params.power_mode = high ? STEPPER_PWR_HIGH : STEPPER_PWR_LOW;
+
+	if( STEPPER_params.curr_speed.left == 0 && !STEPPER_params.brake.left &&
+		STEPPER_params.curr_speed.right == 0 && !STEPPER_params.brake.right )
+		stats.off++;
+	else if( high )
+		stats.high++;
+	else
+		stats.low++;
+}
+
+uint8_t STEPPWR_open( void )
+{
+	return TICK_attach( STEPPWR_tick );
+}
+
+void STEPPWR_set_idle( uint16_t low, uint16_t off )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		idle_low = low;
+		idle_off = off;
+	}
+}
+
+void STEPPWR_get_stats( STEPPWR_STATS *pStats )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		*pStats = stats;
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * steppwr.h
+ *
+ * Stepper power policy.  The API's power mode applies to both motors at
+ * once: in HIGH mode the coils are driven continuously, in LOW mode (the
+ * API default) a braking motor's coils are pulsed every other tick and a
+ * motor below 51 steps/s has its coils switched off between steps.  LOW
+ * costs torque, which matters while a wheel is changing speed and matters
+ * little once it cruises.
+ *
+ * Every system tick the policy picks the mode:
+ *
+ *     HIGH - a wheel is changing speed (API acceleration, velocity slew,
+ *            a start or a stop) or did so less than STEPPWR_SETTLE ticks
+ *            ago, runs slower than STEPPWR_LOW_MIN_SPEED, or has been
+ *            stopped braked for less than the low power idle time.
+ *     LOW  - otherwise: cruising at STEPPWR_LOW_MIN_SPEED or faster,
+ *            holding, or stopped.
+ *
+ * A wheel left braked past the off idle time has its brake released
+ * through the engine (STEPENG_tick_unbrake()), which de-energizes its
+ * coils.  Its position is then no longer held.
+ *
+ * There is no load or current sensing on the board, so heavy load cannot
+ * be told apart from a ramp, and the savings are reported as the ticks
+ * spent in each mode rather than as measured current.
+ *
+ * The policy owns the power mode: do not call STEPPER_set_pwr_mode()
+ * while it runs.
+ */
+#ifndef STEPPWR_H_
+#define STEPPWR_H_
+
+#include <stdint.h>
+
+/* Ticks (~1 ms) HIGH mode is kept after a ramp ends. */
+#ifndef STEPPWR_SETTLE
+	#define STEPPWR_SETTLE		100
+#endif
+
+/* Slowest speed, steps/s, at which a running wheel may be in LOW mode.
+ * Below it LOW switches the coils off between steps. */
+#define STEPPWR_LOW_MIN_SPEED	51
+
+/* Default idle times, ticks: a braked wheel drops to LOW after
+ * STEPPWR_IDLE_LOW and is released after STEPPWR_IDLE_OFF. */
+#ifndef STEPPWR_IDLE_LOW
+	#define STEPPWR_IDLE_LOW	250
+#endif
+
+#ifndef STEPPWR_IDLE_OFF
+	#define STEPPWR_IDLE_OFF	5000
+#endif
+
+/* Ticks spent in each state since STEPPWR_open(). */
+typedef struct STEPPWR_STATS_TYPE {
+
+	uint32_t high;			// A motor energized, HIGH mode.
+	uint32_t low;			// A motor energized, LOW mode.
+	uint32_t off;			// Both motors de-energized.
+	uint16_t releases;		// Brakes released after the off idle time.
+
+} STEPPWR_STATS;
+
+/* Attach the policy to the system tick.  Call once, after STEPENG_open()
+ * and TICK_open().  Returns 0 if no tick hook slot was free. */
+uint8_t STEPPWR_open( void );
+
+/* Idle times of a braked wheel in ticks: LOW mode after 'low' (0: at
+ * once), brake released after 'off' (0: never). */
+void STEPPWR_set_idle( uint16_t low, uint16_t off );
+
+/* Copy the accounting into '*pStats'. */
+void STEPPWR_get_stats( STEPPWR_STATS *pStats );
+
+#endif /* STEPPWR_H_ */
@@ -0,0 +1,117 @@
+/*
+ * tick.c
+ *
+ * System tick hook.  ISR_attach() refuses the Timer0 vectors, which the API
+ * reserves for itself, so the handler is swapped in the ISR table directly.
+ */
+#define F_CPU 20000000UL
+#include "capi324v221.h"
+#include <util/atomic.h>
+#include "stepeng.h"
+#include "tick.h"
+
+static TICK_HOOK hooks[ TICK_MAX_HOOKS ];
+static volatile uint8_t nHooks;
+static volatile uint32_t ticks;
+
+/* Replacement for the API's Timer0 compare A handler. */
+static void TICK_isr( void )
+{
+	uint8_t i;
+
+	ticks++;	// First, so stamps taken by the services below are current.
+
+	TMRSRVC_tick();
+	STEPENG_clk();
+	SPKR_beep_clk();
+
+	for( i = 0; i < nHooks; i++ )
+		hooks[ i ]();
+}
+
+void TICK_open( void )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		CBOT_ISR_vtable[ ISR_TIMER0_COMPA_VECT ] = TICK_isr;
+	}
+}
+
+uint8_t TICK_attach( TICK_HOOK hook )
+{
+	if( nHooks >= TICK_MAX_HOOKS )
+		return 0;
+
+	/* Fill the slot before publishing it to the ISR. */
+	hooks[ nHooks ] = hook;
+	nHooks++;
+
+	return 1;
+}
+
+uint32_t TICK_count( void )
+{
+	uint32_t count;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		count = ticks;
+	}
+
+	return count;
+}
+
+uint32_t TICK_stamp( void )
+{
+	uint32_t count;
+	uint8_t cnt;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		count = ticks;
+		cnt = TCNT0;
+
+		/* Timer0 runs in CTC mode: if the compare has fired but its tick
+		 * is still pending, TCNT0 has already wrapped. */
+		if( TIFR0 & ( 1 << OCF0A ) )
+		{
+			cnt = TCNT0;
+			count++;
+		}
+	}
+
+	return count * ( OCR0A + 1 ) + cnt;
+}
+
+uint16_t TICK_mark( void )
+{
+	uint8_t lo = (uint8_t) ticks;
+	uint8_t cnt = TCNT0;
+
+	if( TIFR0 & ( 1 << OCF0A ) )	// Tick pending, see TICK_stamp().
+	{
+		cnt = TCNT0;
+		lo++;
+	}
+
+	return ( (uint16_t) lo << 8 ) | cnt;
+}
+
+uint16_t TICK_mark_now( void )
+{
+	uint16_t mark;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		mark = TICK_mark();
+	}
+
+	return mark;
+}
+
+uint16_t TICK_mark_diff( uint16_t later, uint16_t earlier )
+{
+	uint8_t dt = (uint8_t)( ( later >> 8 ) - ( earlier >> 8 ) );
+
+	return dt * (uint16_t)( OCR0A + 1 ) + (uint8_t) later - (uint8_t) earlier;
+}
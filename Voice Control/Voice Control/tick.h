@@ -0,0 +1,60 @@
+/*
+ * tick.h
+ *
+ * Hooks into the CEENbot API system tick (Timer0 compare A, ~1 ms).  The
+ * API's own handler is replaced by one that performs the same services
+ * (timer service, stepper clock via STEPENG_clk(), speaker beep clock) and
+ * then runs the functions attached here, still inside the interrupt.
+ */
+#ifndef TICK_H_
+#define TICK_H_
+
+#include <stdint.h>
+
+/* Hook slots. */
+#ifndef TICK_MAX_HOOKS
+	#define TICK_MAX_HOOKS	6
+#endif
+
+/* Hooks the firmware attaches: MOTION, ODOM, STEPPWR and LATENCY.  Count
+ * a new TICK_attach() call here. */
+#define TICK_HOOKS_USED		4
+
+#if TICK_HOOKS_USED > TICK_MAX_HOOKS
+	#error "TICK_MAX_HOOKS is smaller than TICK_HOOKS_USED"
+#endif
+
+typedef void ( *TICK_HOOK )( void );
+
+/* Install the tick handler.  Call once, after the API has been initialized
+ * (i.e. from CBOT_main()). */
+void TICK_open( void );
+
+/* Run 'hook' on every tick, right after the stepper clock.  Hooks execute
+ * with interrupts disabled and must be short.  Returns 1 on success, 0 if
+ * all TICK_MAX_HOOKS slots are taken. */
+uint8_t TICK_attach( TICK_HOOK hook );
+
+/* Ticks since TICK_open(). */
+uint32_t TICK_count( void );
+
+/* Time since TICK_open() in Timer0 counts of 256 / F_CPU = 12.8 us, for
+ * intervals that need better than tick resolution.  Wraps after ~15 h. */
+uint32_t TICK_stamp( void );
+
+/* Convert a TICK_stamp() difference to microseconds. */
+#define TICK_STAMP_TO_US( d )	( ( ( d ) * 64UL ) / 5 )
+
+/* Compact timestamp for interrupt handlers: the low byte of the tick count
+ * in the high byte and TCNT0 in the low byte, so taking one costs no
+ * arithmetic.  Call with interrupts disabled (i.e. from an ISR). */
+uint16_t TICK_mark( void );
+
+/* Time from mark 'earlier' to mark 'later' in TICK_stamp() counts.  Only
+ * valid for intervals shorter than 256 ticks (~259 ms). */
+uint16_t TICK_mark_diff( uint16_t later, uint16_t earlier );
+
+/* TICK_mark() for code running with interrupts enabled. */
+uint16_t TICK_mark_now( void );
+
+#endif /* TICK_H_ */
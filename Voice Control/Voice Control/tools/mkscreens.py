@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""
+mkscreens.py
+
+Pre-renders the status screens declared in screens.txt into LCD page
+bitmaps, written out as screens.c/screens.h for the firmware.  At run time
+a screen is copied from flash into the LCD framebuffer (LCDFB_show()), so
+no formatting or glyph lookup happens on the robot and the text never
+occupies SRAM.
+
+Rendering matches the API's LCD_putchar(): the 5x7 'char_bitmap' font in
+6-pixel cells, each glyph column sent to the LCD as-is.
+
+Usage (from the project directory, after editing screens.txt):
+
+    python tools/mkscreens.py [screens.txt] [output directory]
+
+Declaration format, one screen per 'screen' line:
+
+    screen NAME          # Becomes SCREEN_NAME.
+    ROW TEXT             # Text for row ROW (0 = top); other rows are blank.
+
+Blank lines and lines starting with '#' are ignored.  Text is taken as
+is up to the end of the line, including quotes and inner spaces.
+"""
+import os
+import sys
+
+ROWS = 4            # LCDFB_ROWS
+COLS = 21           # LCD_nCOLS
+CELL = 6            # LCDFB_CELL
+
+# Columns of the API's char_bitmap glyphs for ' '..'~', bit 7 at the top.
+FONT = [
+    (0x00, 0x00, 0x00, 0x00, 0x00), # ' '
+    (0x00, 0x00, 0xFA, 0x00, 0x00), # '!'
+    (0x00, 0xE0, 0x00, 0xE0, 0x00), # '"'
+    (0x28, 0xFE, 0x28, 0xFE, 0x28), # '#'
+    (0x24, 0x54, 0xFE, 0x54, 0x48), # '$'
+    (0xC4, 0xC8, 0x10, 0x26, 0x46), # '%'
+    (0x6C, 0x92, 0xAA, 0x44, 0xA0), # '&'
+    (0x00, 0xA0, 0xC0, 0x00, 0x00), # "'"
+    (0x00, 0x38, 0x44, 0x82, 0x00), # '('
+    (0x00, 0x82, 0x44, 0x38, 0x00), # ')'
+    (0x28, 0x10, 0x7C, 0x10, 0x28), # '*'
+    (0x10, 0x10, 0x7C, 0x10, 0x10), # '+'
+    (0x00, 0x0A, 0x0C, 0x00, 0x00), # ','
+    (0x10, 0x10, 0x10, 0x10, 0x10), # '-'
+    (0x00, 0x06, 0x06, 0x00, 0x00), # '.'
+    (0x04, 0x08, 0x10, 0x20, 0x40), # '/'
+    (0x7C, 0x8A, 0x92, 0xA2, 0x7C), # '0'
+    (0x00, 0x42, 0xFE, 0x02, 0x00), # '1'
+    (0x42, 0x86, 0x8A, 0x92, 0x62), # '2'
+    (0x84, 0x82, 0xA2, 0xD2, 0x8C), # '3'
+    (0x18, 0x28, 0x48, 0xFE, 0x08), # '4'
+    (0xE4, 0xA2, 0xA2, 0xA2, 0x9C), # '5'
+    (0x3C, 0x52, 0x92, 0x92, 0x0C), # '6'
+    (0x80, 0x8E, 0x90, 0xA0, 0xC0), # '7'
+    (0x6C, 0x92, 0x92, 0x92, 0x6C), # '8'
+    (0x60, 0x92, 0x92, 0x94, 0x78), # '9'
+    (0x00, 0x6C, 0x6C, 0x00, 0x00), # ':'
+    (0x00, 0x6A, 0x6C, 0x00, 0x00), # ';'
+    (0x10, 0x28, 0x44, 0x82, 0x00), # '<'
+    (0x28, 0x28, 0x28, 0x28, 0x28), # '='
+    (0x00, 0x82, 0x44, 0x28, 0x10), # '>'
+    (0x40, 0x80, 0x8A, 0x90, 0x60), # '?'
+    (0x4C, 0x92, 0x9E, 0x82, 0x7C), # '@'
+    (0x7E, 0x88, 0x88, 0x88, 0x7E), # 'A'
+    (0xFE, 0x92, 0x92, 0x92, 0x6C), # 'B'
+    (0x7C, 0x82, 0x82, 0x82, 0x44), # 'C'
+    (0xFE, 0x82, 0x82, 0x44, 0x38), # 'D'
+    (0xFE, 0x92, 0x92, 0x92, 0x82), # 'E'
+    (0xFE, 0x90, 0x90, 0x90, 0x80), # 'F'
+    (0x7C, 0x82, 0x92, 0x92, 0x5E), # 'G'
+    (0xFE, 0x10, 0x10, 0x10, 0xFE), # 'H'
+    (0x00, 0x82, 0xFE, 0x82, 0x00), # 'I'
+    (0x04, 0x02, 0x82, 0xFC, 0x80), # 'J'
+    (0xFE, 0x10, 0x28, 0x44, 0x82), # 'K'
+    (0xFE, 0x02, 0x02, 0x02, 0x02), # 'L'
+    (0xFE, 0x40, 0x30, 0x40, 0xFE), # 'M'
+    (0xFE, 0x20, 0x10, 0x08, 0xFE), # 'N'
+    (0x7C, 0x82, 0x82, 0x82, 0x7C), # 'O'
+    (0xFE, 0x90, 0x90, 0x90, 0x60), # 'P'
+    (0x7C, 0x82, 0x8A, 0x84, 0x7A), # 'Q'
+    (0xFE, 0x90, 0x98, 0x94, 0x62), # 'R'
+    (0x62, 0x92, 0x92, 0x92, 0x8C), # 'S'
+    (0x80, 0x80, 0xFE, 0x80, 0x80), # 'T'
+    (0xFC, 0x02, 0x02, 0x02, 0xFC), # 'U'
+    (0xF8, 0x04, 0x02, 0x04, 0xF8), # 'V'
+    (0xFC, 0x02, 0x1C, 0x02, 0xFC), # 'W'
+    (0xC6, 0x28, 0x10, 0x28, 0xC6), # 'X'
+    (0xE0, 0x10, 0x0E, 0x10, 0xE0), # 'Y'
+    (0x86, 0x8A, 0x92, 0xA2, 0xC2), # 'Z'
+    (0x00, 0xFE, 0x82, 0x82, 0x00), # '['
+    (0x40, 0x20, 0x10, 0x08, 0x04), # '\\'
+    (0x00, 0x82, 0x82, 0xFE, 0x00), # ']'
+    (0x20, 0x40, 0x80, 0x40, 0x20), # '^'
+    (0x02, 0x02, 0x02, 0x02, 0x02), # '_'
+    (0x00, 0x80, 0x40, 0x20, 0x00), # '`'
+    (0x04, 0x2A, 0x2A, 0x2A, 0x1E), # 'a'
+    (0xFE, 0x12, 0x22, 0x22, 0x1C), # 'b'
+    (0x1C, 0x22, 0x22, 0x22, 0x04), # 'c'
+    (0x1C, 0x22, 0x22, 0x12, 0xFE), # 'd'
+    (0x1C, 0x2A, 0x2A, 0x2A, 0x18), # 'e'
+    (0x10, 0x7E, 0x90, 0x80, 0x40), # 'f'
+    (0x30, 0x4A, 0x4A, 0x4A, 0x7C), # 'g'
+    (0xFE, 0x10, 0x20, 0x20, 0x1E), # 'h'
+    (0x00, 0x22, 0xBE, 0x02, 0x00), # 'i'
+    (0x04, 0x02, 0x22, 0xBC, 0x00), # 'j'
+    (0xFE, 0x08, 0x14, 0x22, 0x00), # 'k'
+    (0x00, 0x82, 0xFE, 0x02, 0x00), # 'l'
+    (0x3E, 0x20, 0x18, 0x20, 0x1E), # 'm'
+    (0x3E, 0x10, 0x20, 0x20, 0x1E), # 'n'
+    (0x1C, 0x22, 0x22, 0x22, 0x1C), # 'o'
+    (0x3E, 0x28, 0x28, 0x28, 0x10), # 'p'
+    (0x10, 0x28, 0x28, 0x18, 0x3E), # 'q'
+    (0x3E, 0x10, 0x20, 0x20, 0x10), # 'r'
+    (0x12, 0x2A, 0x2A, 0x2A, 0x04), # 's'
+    (0x20, 0xFC, 0x22, 0x02, 0x04), # 't'
+    (0x3C, 0x02, 0x02, 0x04, 0x3E), # 'u'
+    (0x38, 0x04, 0x02, 0x04, 0x38), # 'v'
+    (0x3C, 0x02, 0x0C, 0x02, 0x3C), # 'w'
+    (0x22, 0x14, 0x08, 0x14, 0x22), # 'x'
+    (0x30, 0x0A, 0x0A, 0x0A, 0x3C), # 'y'
+    (0x22, 0x26, 0x2A, 0x32, 0x22), # 'z'
+    (0x00, 0x10, 0x6C, 0x82, 0x00), # '{'
+    (0x00, 0x00, 0xFE, 0x00, 0x00), # '|'
+    (0x00, 0x82, 0x6C, 0x10, 0x00), # '}'
+    (0x08, 0x10, 0x10, 0x08, 0x10), # '~'
+]
+
+
+class ScreenError(Exception):
+    pass
+
+
+def render(text):
+    """Return the page bytes for one row of text."""
+    bits = []
+    for ch in text:
+        code = ord(ch)
+        if code < 0x20 or code > 0x7E:
+            raise ScreenError("character %r cannot be drawn" % ch)
+        bits.extend(FONT[code - 0x20])
+        bits.append(0x00)       # Gap to the next cell.
+    return bits
+
+
+def parse(path):
+    """Return [(name, {row: text})] in declaration order."""
+    screens = []
+    names = set()
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.rstrip("\r\n")
+            where = "%s:%d: " % (path, number)
+            if not line.strip() or line.lstrip().startswith("#"):
+                continue
+            head, _, rest = line.partition(" ")
+            if head == "screen":
+                name = rest.strip()
+                if not name.isidentifier() or name in names:
+                    raise ScreenError(where + "bad or repeated screen name")
+                names.add(name)
+                screens.append((name, {}))
+                continue
+            if not screens:
+                raise ScreenError(where + "row before the first 'screen'")
+            if not head.isdigit() or int(head) >= ROWS:
+                raise ScreenError(where + "row must be 0..%d" % (ROWS - 1))
+            if len(rest) > COLS:
+                raise ScreenError(where + "more than %d characters" % COLS)
+            render(rest)        # Check the characters.
+            rows = screens[-1][1]
+            if int(head) in rows:
+                raise ScreenError(where + "row given twice")
+            rows[int(head)] = rest
+    return screens
+
+
+def write_source(screens, src, out):
+    out.write("/*\n * screens.c\n *\n"
+              " * Generated by tools/mkscreens.py from %s.  Do not edit.\n"
+              " */\n" % src)
+    out.write("#include <avr/pgmspace.h>\n#include \"screens.h\"\n")
+    for name, rows in screens:
+        for row in sorted(rows):
+            bits = render(rows[row])
+            out.write("\n/* %s */\n" % rows[row].replace("*/", "* /"))
+            out.write("static const uint8_t %s_%d[] PROGMEM = {\n" % (name, row))
+            for i in range(0, len(bits), CELL * 2):
+                out.write("\t" + ", ".join("0x%02X" % b for b in bits[i:i + CELL * 2]) + ",\n")
+            out.write("};\n")
+        out.write("\nconst LCDFB_SCREEN SCREEN_%s PROGMEM = {{\n" % name)
+        for row in range(ROWS):
+            if row in rows:
+                out.write("\t{ %s_%d, %d },\n" % (name, row, len(rows[row]) * CELL))
+            else:
+                out.write("\t{ NULL, 0 },\n")
+        out.write("}};\n")
+
+
+def write_header(screens, src, out):
+    out.write("/*\n * screens.h\n *\n"
+              " * Generated by tools/mkscreens.py from %s.  Do not edit.\n"
+              " */\n" % src)
+    out.write("#ifndef SCREENS_H_\n#define SCREENS_H_\n\n")
+    out.write("#include \"lcdfb.h\"\n\n")
+    for name, _ in screens:
+        out.write("extern const LCDFB_SCREEN SCREEN_%s;\n" % name)
+    out.write("\n#endif /* SCREENS_H_ */\n")
+
+
+def main(argv):
+    here = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    src = argv[1] if len(argv) > 1 else os.path.join(here, "screens.txt")
+    dest = argv[2] if len(argv) > 2 else os.path.dirname(os.path.abspath(src))
+
+    try:
+        screens = parse(src)
+    except (ScreenError, OSError) as e:
+        sys.exit("mkscreens: %s" % e)
+
+    # AVR Studio keeps the sources with CRLF line endings.
+    name = os.path.basename(src)
+    with open(os.path.join(dest, "screens.c"), "w", newline="\r\n") as out:
+        write_source(screens, name, out)
+    with open(os.path.join(dest, "screens.h"), "w", newline="\r\n") as out:
+        write_header(screens, name, out)
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -0,0 +1,204 @@
+/*
+ * units_test.c
+ *
+ * Host check of every conversion in units.h against a float reference,
+ * over each conversion's whole documented input range.  The reference is
+ * the API's float macro where there is one (STEP_FEET(), REVS_PER_SEC(),
+ * SPKR_FREQ()) and otherwise the formula written out in float from the
+ * wheel diameter or the unit definition.  A conversion passes if it never
+ * differs from the float value by a full output unit; the worst difference
+ * is printed either way.
+ *
+ * Build and run with the host compiler, from the project directory:
+ *
+ *     gcc -std=c99 -Wall -I"CEENbot API/lib-includes" -o units_test \
+ *         tools/units_test.c -lm && ./units_test
+ *
+ * Add -DUNITS_WHEEL_DIAM=... to check a wheel calibration.  The exit
+ * status is the number of conversions that failed.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* units.h needs STEPS_PER_RVLTN, SPKR_FREQ and F_CPU from the API, whose
+ * headers are for the AVR; keep them out and give the values of
+ * step324v221.h, spkr324v221.h and the firmware. */
+#define __CAPI324V221_H__
+#define STEPS_PER_RVLTN		200
+#define F_CPU				20000000UL
+typedef signed long int SPKR_FREQ;
+
+#include "../units.h"
+
+/* The float references.  The API macros (closing parenthesis added to
+ * STEP_FEET()) are taken before their cast to an integer, which truncates
+ * where units.h rounds.  float, like double on the AVR. */
+#define PI_F		3.14159265f
+#define MM_PER_STEP_F	( PI_F * UNITS_WHEEL_DIAM / 10.0f / STEPS_PER_RVLTN )
+
+#define FLOAT_STEP_FEET( d )	( (float)( d ) / 0.04328f )
+#define FLOAT_MM_STEPS( mm )	( (float)( mm ) / MM_PER_STEP_F )
+#define FLOAT_STEPS_MM( s )		( (float)( s ) * MM_PER_STEP_F )
+#define FLOAT_DEG_BAM( deg )	( (float)( deg ) * 65536.0f / 360.0f )
+#define FLOAT_BAM_DEG( bam )	( (float)( bam ) * 360.0f / 65536.0f )
+#define FLOAT_DEG_MRAD( deg )	( (float)( deg ) * 1000.0f * PI_F / 180.0f )
+#define FLOAT_REVS_STEPS( r )	( ( r ) * ( STEPS_PER_RVLTN ) )
+#define FLOAT_SPKR_FREQ( f )	( ( f ) * 10.0f )
+#define FLOAT_TIMER_TOP( hz, p )	( (float) F_CPU / ( (float)( p ) * ( hz ) ) - 1.0f )
+
+/* Worst difference of one conversion so far. */
+typedef struct RESULT_TYPE {
+
+	const char *name;
+	double worst;
+	long at;
+
+} RESULT;
+
+static int failed;
+
+/* Note the difference between 'fixed' and 'ref' at input 'x'. */
+static void note( RESULT *pR, long x, double fixed, double ref )
+{
+	double d = fabs( fixed - ref );
+
+	if( d > pR->worst )
+	{
+		pR->worst = d;
+		pR->at = x;
+	}
+}
+
+static void report( const RESULT *pR )
+{
+	int ok = pR->worst < 1.0;
+
+	printf( "%-18s worst %.4f at %ld  %s\n", pR->name, pR->worst, pR->at,
+		ok ? "ok" : "FAIL" );
+
+	if( !ok )
+		failed++;
+}
+
+/* Difference of two binary angles taken around the circle. */
+static double bam_diff( double a, double b )
+{
+	double d = fmod( a - b, 65536.0 );
+
+	if( d < -32768.0 )
+		d += 65536.0;
+	else if( d > 32768.0 )
+		d -= 65536.0;
+
+	return d;
+}
+
+/* Distance, and linear speed and acceleration, which convert alike (the
+ * turn speeds of kin.h go through UNITS_MM_STEPS()). */
+static void test_distance( void )
+{
+	RESULT mm_steps = { "UNITS_MM_STEPS", 0, 0 };
+	RESULT steps_mm = { "UNITS_STEPS_MM", 0, 0 };
+	RESULT mmps_steps = { "UNITS_MMPS_STEPS", 0, 0 };
+	RESULT steps_mmps = { "UNITS_STEPS_MMPS", 0, 0 };
+	RESULT step_feet = { "STEP_FEET", 0, 0 };
+	long x;
+
+	for( x = 0; x <= 65535; x++ )
+	{
+		note( &mm_steps, x, UNITS_MM_STEPS( x ), FLOAT_MM_STEPS( x ) );
+		note( &mmps_steps, x, UNITS_MMPS_STEPS( x ), FLOAT_MM_STEPS( x ) );
+	}
+
+	for( x = 0; x <= 32767; x++ )
+	{
+		note( &steps_mm, x, UNITS_STEPS_MM( x ), FLOAT_STEPS_MM( x ) );
+		note( &steps_mmps, x, UNITS_STEPS_MMPS( x ), FLOAT_STEPS_MM( x ) );
+	}
+
+	for( x = 0; x <= 2836; x++ )
+		note( &step_feet, x, STEP_FEET( x ), FLOAT_STEP_FEET( x ) );
+
+	report( &mm_steps );
+	report( &steps_mm );
+	report( &mmps_steps );
+	report( &steps_mmps );
+	report( &step_feet );
+}
+
+static void test_angle( void )
+{
+	RESULT deg_bam = { "UNITS_DEG_BAM", 0, 0 };
+	RESULT bam_deg = { "UNITS_BAM_DEG", 0, 0 };
+	RESULT deg_mrad = { "UNITS_DEG_MRAD", 0, 0 };
+	long x;
+
+	for( x = -3600; x <= 3600; x++ )
+		note( &deg_bam, x,
+			bam_diff( UNITS_DEG_BAM( x ), FLOAT_DEG_BAM( x ) ), 0 );
+
+	for( x = -32768; x <= 32767; x++ )
+		note( &bam_deg, x, UNITS_BAM_DEG( (uint16_t) x ), FLOAT_BAM_DEG( x ) );
+
+	for( x = 0; x <= 3600; x++ )
+		note( &deg_mrad, x, UNITS_DEG_MRAD( x ), FLOAT_DEG_MRAD( x ) );
+
+	report( &deg_bam );
+	report( &bam_deg );
+	report( &deg_mrad );
+}
+
+/* Rotational speed, 1/100 rev/s up to the 16-bit step rate limit. */
+static void test_revs( void )
+{
+	RESULT revs_steps = { "UNITS_REVS_STEPS", 0, 0 };
+	long x;
+
+	for( x = 0; x <= 32767; x++ )
+		note( &revs_steps, x, UNITS_REVS_STEPS( x ),
+			FLOAT_REVS_STEPS( x / 100.0f ) );
+
+	report( &revs_steps );
+}
+
+/* Speaker frequencies in 1/100 Hz up to 20 kHz, and timer compare values
+ * for each Timer0/1 prescaler, from the slowest rate whose value fits 16
+ * bits up to 100 kHz. */
+static void test_frequency( void )
+{
+	static const uint16_t prescale[] = { 1, 8, 64, 256, 1024 };
+	RESULT spkr_freq = { "UNITS_SPKR_FREQ", 0, 0 };
+	RESULT timer_top = { "UNITS_TIMER_TOP", 0, 0 };
+	long x;
+	uint8_t i;
+
+	for( x = 0; x <= 2000000; x++ )
+		note( &spkr_freq, x, UNITS_SPKR_FREQ( x ), FLOAT_SPKR_FREQ( x / 100.0f ) );
+
+	for( i = 0; i < sizeof( prescale ) / sizeof( prescale[ 0 ] ); i++ )
+	{
+		for( x = F_CPU / ( prescale[ i ] * 65536UL ) + 1; x <= 100000; x++ )
+		{
+			if( F_CPU / ( prescale[ i ] * (uint32_t) x ) < 2 )
+				break;
+
+			note( &timer_top, x * 10000L + prescale[ i ],
+				UNITS_TIMER_TOP( x, prescale[ i ] ),
+				FLOAT_TIMER_TOP( x, prescale[ i ] ) );
+		}
+	}
+
+	report( &spkr_freq );
+	report( &timer_top );
+}
+
+int main( void )
+{
+	test_distance();
+	test_angle();
+	test_revs();
+	test_frequency();
+
+	return failed;
+}
@@ -0,0 +1,166 @@
+/*
+ * units.h
+ *
+ * Fixed-point unit conversions.  Every factor is a Q-format integer worked
+ * out by the preprocessor from exact rationals, so a conversion costs one
+ * 32-bit multiply and a shift and never pulls in the float emulation
+ * (__mulsf3, __divsf3, __floatunsisf...).  With a constant argument the
+ * compiler folds the whole conversion.
+ *
+ *     Distance  - mm, feet <-> steps (wheel diameter calibration below)
+ *     Angle     - degrees <-> binary angle (65536 per turn), milliradians
+ *     Speed     - mm/s <-> steps/s, rev/s -> steps/s
+ *     Frequency - Hz -> SPKR_FREQ, Hz -> timer compare value
+ *
+ * Including this header replaces the API's STEP_FEET(), which divides by a
+ * float constant (and lacks a closing parenthesis), with an equivalent
+ * fixed-point version.  Results agree with the float macro to within one
+ * step over its whole range; integer arguments stay in integer arithmetic.
+ *
+ * Each factor is checked at compile time against the exact value: the
+ * worst-case error over the documented input range, in thousandths of an
+ * output unit, must stay under UNITS_MAX_ERR or the build stops.
+ * tools/units_test.c compares every conversion here with its float
+ * reference on the host.
+ */
+#ifndef UNITS_H_
+#define UNITS_H_
+
+#include <stdint.h>
+#include "capi324v221.h"
+
+/* Wheel diameter in 0.1 mm.  The default matches the old hard-coded turns;
+ * measure the robot and override. */
+#ifndef UNITS_WHEEL_DIAM
+	#define UNITS_WHEEL_DIAM	762
+#endif
+
+/* Largest error allowed by the checks below, 1/1000 of an output unit. */
+#define UNITS_MAX_ERR		1000
+
+/* Rounded Q'q' fixed-point constant for the fraction 'num' / 'den'.  Usable
+ * in #if, so no casts: the 1ULL does the widening. */
+#define UNITS_Q( num, den, q ) \
+	( ( ( ( num ) * 1ULL << ( q ) ) + ( den ) / 2 ) / ( den ) )
+
+/* 'x' times Q'q' factor 'k', rounded, in unsigned 32-bit arithmetic.  The
+ * checks below make sure the product fits for the input range given with
+ * each factor. */
+#define UNITS_MUL( x, k, q ) \
+	( (uint32_t)( ( (uint32_t)( x ) * (uint32_t)( k ) + ( 1UL << ( ( q ) - 1 ) ) ) >> ( q ) ) )
+
+/* Worst error of Q'q' factor 'k' for 'num' / 'den' at input 'xmax', in
+ * 1/1000 of an output unit, including the final rounding (500). */
+#define UNITS_ERR( k, num, den, q, xmax ) \
+	( ( ( ( k ) * 1ULL * ( den ) > ( ( num ) * 1ULL << ( q ) ) ? \
+		  ( k ) * 1ULL * ( den ) - ( ( num ) * 1ULL << ( q ) ) : \
+		  ( ( num ) * 1ULL << ( q ) ) - ( k ) * 1ULL * ( den ) ) * \
+		( xmax ) * 1000 ) / ( ( den ) * 1ULL << ( q ) ) + 500 )
+
+/* Does UNITS_MUL( 'xmax', 'k', 'q' ) fit in 32 bits? */
+#define UNITS_FITS( k, q, xmax ) \
+	( ( k ) * 1ULL * ( xmax ) + ( 1ULL << ( ( q ) - 1 ) ) <= 0xFFFFFFFFULL )
+
+/* ----------------------------------------------------------------------- */
+/* Distance.  pi is taken as 355/113 (error 8.5e-8). */
+
+/* Steps per mm: STEPS_PER_RVLTN / ( pi * D ), inputs up to 65535 mm. */
+#define UNITS_STEPS_PER_MM_NUM	( 10ULL * STEPS_PER_RVLTN * 113 )
+#define UNITS_STEPS_PER_MM_DEN	( 355ULL * UNITS_WHEEL_DIAM )
+#define UNITS_STEPS_PER_MM_Q16	\
+	UNITS_Q( UNITS_STEPS_PER_MM_NUM, UNITS_STEPS_PER_MM_DEN, 16 )
+
+/* mm per step, Q16: pi * D / STEPS_PER_RVLTN, inputs up to 32767 steps. */
+#define UNITS_MM_PER_STEP_Q16	\
+	UNITS_Q( UNITS_STEPS_PER_MM_DEN, UNITS_STEPS_PER_MM_NUM, 16 )
+
+#define UNITS_MM_STEPS( mm )		UNITS_MUL( mm, UNITS_STEPS_PER_MM_Q16, 16 )
+#define UNITS_STEPS_MM( steps )		UNITS_MUL( steps, UNITS_MM_PER_STEP_Q16, 16 )
+
+/* Steps per foot as the API defines it (1 step = 0.04328 ft), Q8, inputs up
+ * to 2836 ft (65535 steps). */
+#define UNITS_STEPS_PER_FT_Q8	UNITS_Q( 100000, 4328, 8 )
+
+#undef STEP_FEET
+#define STEP_FEET( d ) \
+	( ( unsigned short int )( ( ( d ) * (uint32_t) UNITS_STEPS_PER_FT_Q8 + 128 ) / 256 ) )
+
+/* ----------------------------------------------------------------------- */
+/* Angle. */
+
+/* Binary angle units (65536 per turn) per degree, Q12, inputs up to +/-3600
+ * degrees.  The result wraps naturally in an int16_t/uint16_t. */
+#define UNITS_BAM_PER_DEG_Q12	UNITS_Q( 65536, 360, 12 )
+
+#define UNITS_DEG_BAM( deg ) \
+	( (uint16_t)( ( deg ) < 0 ? \
+		-UNITS_MUL( -(int32_t)( deg ), UNITS_BAM_PER_DEG_Q12, 12 ) : \
+		 UNITS_MUL( deg, UNITS_BAM_PER_DEG_Q12, 12 ) ) )
+
+/* Binary angle to degrees: 360 / 65536 is exactly 45 / 8192. */
+#define UNITS_BAM_DEG( bam ) \
+	( (int16_t)( ( (int32_t)(int16_t)( bam ) * 45 + 4096 ) >> 13 ) )
+
+/* Milliradians per degree, Q16: 1000 * pi / 180, inputs up to 3600
+ * degrees. */
+#define UNITS_MRAD_PER_DEG_Q16	UNITS_Q( 1000ULL * 355, 180ULL * 113, 16 )
+
+#define UNITS_DEG_MRAD( deg )		UNITS_MUL( deg, UNITS_MRAD_PER_DEG_Q16, 16 )
+
+/* ----------------------------------------------------------------------- */
+/* Speed.  Linear speeds and accelerations convert like distances. */
+
+#define UNITS_MMPS_STEPS( mmps )	UNITS_MM_STEPS( mmps )
+#define UNITS_STEPS_MMPS( sps )		UNITS_STEPS_MM( sps )
+
+/* Revolutions per second in 1/100 rev/s to steps/s; REVS_PER_SEC( 1.7 )
+ * becomes UNITS_REVS_STEPS( 170 ). */
+#define UNITS_REVS_STEPS( crps ) \
+	( (uint16_t)( ( (uint32_t)( crps ) * STEPS_PER_RVLTN + 50 ) / 100 ) )
+
+/* ----------------------------------------------------------------------- */
+/* Frequency. */
+
+/* Frequency in 1/100 Hz to SPKR_FREQ (1/10 Hz); SPKR_FREQ( 16.35 ) becomes
+ * UNITS_SPKR_FREQ( 1635 ). */
+#define UNITS_SPKR_FREQ( chz )		( (SPKR_FREQ)( ( ( chz ) + 5 ) / 10 ) )
+
+/* Compare value giving 'hz' on a timer in CTC mode clocked at F_CPU /
+ * 'prescale'.  Constant arguments only; the division is done by the
+ * compiler. */
+#define UNITS_TIMER_TOP( hz, prescale ) \
+	( ( F_CPU + (uint32_t)( prescale ) * ( hz ) / 2 ) / \
+	  ( (uint32_t)( prescale ) * ( hz ) ) - 1 )
+
+/* ----------------------------------------------------------------------- */
+/* Compile-time accuracy checks against the exact fractions. */
+
+#if !UNITS_FITS( UNITS_STEPS_PER_MM_Q16, 16, 65535 ) || \
+	UNITS_ERR( UNITS_STEPS_PER_MM_Q16, UNITS_STEPS_PER_MM_NUM, \
+		UNITS_STEPS_PER_MM_DEN, 16, 65535 ) >= UNITS_MAX_ERR
+	#error "UNITS_MM_STEPS() out of range or tolerance: check UNITS_WHEEL_DIAM"
+#endif
+
+#if !UNITS_FITS( UNITS_MM_PER_STEP_Q16, 16, 32767 ) || \
+	UNITS_ERR( UNITS_MM_PER_STEP_Q16, UNITS_STEPS_PER_MM_DEN, \
+		UNITS_STEPS_PER_MM_NUM, 16, 32767 ) >= UNITS_MAX_ERR
+	#error "UNITS_STEPS_MM() out of range or tolerance: check UNITS_WHEEL_DIAM"
+#endif
+
+#if !UNITS_FITS( UNITS_STEPS_PER_FT_Q8, 8, 2836 ) || \
+	UNITS_ERR( UNITS_STEPS_PER_FT_Q8, 100000, 4328, 8, 2836 ) >= UNITS_MAX_ERR
+	#error "STEP_FEET() out of range or tolerance"
+#endif
+
+#if !UNITS_FITS( UNITS_BAM_PER_DEG_Q12, 12, 3600 ) || \
+	UNITS_ERR( UNITS_BAM_PER_DEG_Q12, 65536, 360, 12, 3600 ) >= UNITS_MAX_ERR
+	#error "UNITS_DEG_BAM() out of range or tolerance"
+#endif
+
+#if !UNITS_FITS( UNITS_MRAD_PER_DEG_Q16, 16, 3600 ) || \
+	UNITS_ERR( UNITS_MRAD_PER_DEG_Q16, 1000ULL * 355, 180ULL * 113, 16, 3600 ) >= \
+		UNITS_MAX_ERR
+	#error "UNITS_DEG_MRAD() out of range or tolerance"
+#endif
+
+#endif /* UNITS_H_ */
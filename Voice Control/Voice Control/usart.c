@@ -0,0 +1,286 @@
+/*
+ * usart.c
+ *
+ * USART0 driver: interrupt-fed receive and transmit ring buffers and
+ * run-time baud selection.
+ */
+#define F_CPU 20000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "tick.h"
+#include "usart.h"
+
+/* Receive ring.  The ISR is the only writer of 'rx_head' and the main loop
+ * the only writer of 'rx_tail'; both are single bytes, so each side sees a
+ * consistent value without locking.  The indices run freely and are masked
+ * on access, which lets the ring hold all USART_RX_SIZE bytes. */
+static volatile uint8_t rx_buf[ USART_RX_SIZE ];
+static volatile uint16_t rx_mark[ USART_RX_SIZE ];	// Arrival time of each byte.
+static volatile uint8_t rx_head;
+static volatile uint8_t rx_tail;
+
+/* Transmit ring, same scheme with the roles swapped: the main loop owns
+ * 'tx_head' and the UDRE ISR owns 'tx_tail'. */
+static volatile uint8_t tx_buf[ USART_TX_SIZE ];
+static volatile uint8_t tx_head;
+static volatile uint8_t tx_tail;
+
+static volatile USART_STATS stats;
+
+/* Divisor and U2X setting for each USART_BAUD, in enum order. */
+static const struct {
+
+	uint8_t ubrr;
+	uint8_t u2x;
+
+} baud_table[ USART_BAUD_COUNT ] = {
+
+	{ 129, 0 },		// 9600
+	{   9, 1 },		// 250k
+	{   4, 1 },		// 500k
+	{   1, 1 }		// 1.25M
+};
+
+static USART_BAUD curr_baud;
+static volatile uint8_t tx_used;	// A byte was sent since the line was last idle.
+
+/* Baud switch waiting for the bytes queued before it to go out. */
+static volatile uint8_t switch_to;	// USART_BAUD + 1; 0: none.
+static volatile uint8_t switch_at;	// 'tx_tail' at which to switch.
+
+/* Set the line to 'which'. */
+static void apply_baud( uint8_t which )
+{
+	UBRR0H = 0;
+	UBRR0L = baud_table[ which ].ubrr;
+	UCSR0A = baud_table[ which ].u2x ? ( 1 << U2X0 ) : 0;
+}
+
+void USART_Init( unsigned int ubrr)
+{
+	/*Set baud rate */
+    UBRR0H = (ubrr >> 8);
+    UBRR0L = ubrr;
+	UCSR0A = 0;			// Normal speed (U2X off).
+	curr_baud = USART_BAUD_9600;
+	tx_used = 0;
+	switch_to = 0;
+
+	rx_head = 0;
+	rx_tail = 0;
+	tx_head = 0;
+	tx_tail = 0;
+
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);      // Enable receiver and transmitter and interrupt receive
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);    // Set frame: 8data, 1 stp
+}
+
+uint8_t USART_available( void )
+{
+	return (uint8_t)( rx_head - rx_tail );
+}
+
+uint8_t USART_getc( uint8_t *pDest )
+{
+	uint8_t tail = rx_tail;
+
+	if( rx_head == tail )
+		return 0;
+
+	*pDest = rx_buf[ tail & USART_RX_MASK ];
+	rx_tail = tail + 1;		// Release the slot only after it was read.
+
+	return 1;
+}
+
+uint8_t USART_getc_mark( uint8_t *pDest, uint16_t *pMark )
+{
+	uint8_t tail = rx_tail;
+
+	if( rx_head == tail )
+		return 0;
+
+	*pDest = rx_buf[ tail & USART_RX_MASK ];
+	*pMark = rx_mark[ tail & USART_RX_MASK ];
+	rx_tail = tail + 1;
+
+	return 1;
+}
+
+uint8_t USART_read( uint8_t *pDest, uint8_t max )
+{
+	uint8_t tail = rx_tail;
+	uint8_t count = (uint8_t)( rx_head - tail );
+	uint8_t i;
+
+	if( count > max )
+		count = max;
+
+	for( i = 0; i < count; i++ )
+		pDest[ i ] = rx_buf[ ( tail + i ) & USART_RX_MASK ];
+
+	rx_tail = tail + count;
+
+	return count;
+}
+
+uint8_t USART_tx_free( void )
+{
+	return (uint8_t)( USART_TX_SIZE - (uint8_t)( tx_head - tx_tail ) );
+}
+
+uint8_t USART_write( const uint8_t *pSrc, uint8_t len )
+{
+	uint8_t head = tx_head;
+	uint8_t count = USART_tx_free();
+	uint8_t used;
+	uint8_t i;
+
+	if( len > count )
+		stats.tx_dropped += len - count;	// Only written here, no ISR race.
+	else
+		count = len;
+
+	if( count == 0 )
+		return 0;
+
+	for( i = 0; i < count; i++ )
+		tx_buf[ ( head + i ) & USART_TX_MASK ] = pSrc[ i ];
+
+	tx_head = head + count;		// Publish the bytes, then wake the ISR.
+	UCSR0B |= ( 1 << UDRIE0 );
+
+	used = (uint8_t)( tx_head - tx_tail );
+	if( used > stats.tx_peak )
+		stats.tx_peak = used;
+
+	return count;
+}
+
+uint8_t USART_putc( uint8_t data )
+{
+	return USART_write( &data, 1 );
+}
+
+void USART_set_baud( USART_BAUD which )
+{
+	if( which >= USART_BAUD_COUNT )
+		return;
+
+	/* Everything queued so far (e.g. the ACK for the switch request) goes
+	 * out at the old rate: the UDRE interrupt stops at 'switch_at' and the
+	 * TXC interrupt switches once the last of it has left the shift
+	 * register. */
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		switch_to = which + 1;
+		switch_at = tx_head;
+		curr_baud = which;
+		UCSR0B |= ( 1 << UDRIE0 );
+	}
+}
+
+USART_BAUD USART_get_baud( void )
+{
+	return curr_baud;
+}
+
+void USART_get_stats( USART_STATS *pStats )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		*pStats = stats;
+	}
+}
+
+void USART_clear_stats( void )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+	{
+		stats.rx_dropped = 0;
+		stats.rx_overruns = 0;
+		stats.rx_frame_errors = 0;
+		stats.rx_peak = 0;
+		stats.tx_dropped = 0;
+		stats.tx_peak = 0;
+	}
+}
+
+ISR(USART0_RX_vect)
+{
+	uint8_t status = UCSR0A;	// Error flags are only valid before UDR0 is read.
+	uint8_t data = UDR0;
+	uint8_t head = rx_head;
+	uint8_t used;
+
+	if( status & ( ( 1 << DOR0 ) | ( 1 << FE0 ) ) )
+	{
+		if( status & ( 1 << DOR0 ) )
+			stats.rx_overruns++;
+		if( status & ( 1 << FE0 ) )
+			stats.rx_frame_errors++;
+	}
+
+	if( (uint8_t)( head - rx_tail ) == USART_RX_SIZE )
+	{
+		stats.rx_dropped++;		// Ring full: keep the oldest bytes.
+		return;
+	}
+
+	rx_buf[ head & USART_RX_MASK ] = data;
+	rx_mark[ head & USART_RX_MASK ] = TICK_mark();
+	rx_head = ++head;
+
+	used = (uint8_t)( head - rx_tail );
+	if( used > stats.rx_peak )
+		stats.rx_peak = used;
+}
+
+ISR(USART0_UDRE_vect)
+{
+	uint8_t tail = tx_tail;
+
+	if( tx_head == tail || ( switch_to && tail == switch_at ) )
+	{
+		UCSR0B &= ~( 1 << UDRIE0 );		// Ring empty: stop interrupting.
+
+		/* A baud switch is due: at once if nothing is being sent, else
+		 * when the last byte is out. */
+		if( switch_to )
+		{
+			if( tx_used )
+				UCSR0B |= ( 1 << TXCIE0 );
+			else
+			{
+				apply_baud( switch_to - 1 );
+				switch_to = 0;
+				if( tx_head != tail )
+					UCSR0B |= ( 1 << UDRIE0 );
+			}
+		}
+		return;
+	}
+
+	/* Clear TXC0 (write one) so the TXC interrupt of a baud switch sees
+	 * when this byte has left the shift register.  FE0/DOR0/UPE0 must be
+	 * written as zero. */
+	UCSR0A = ( UCSR0A & ( ( 1 << U2X0 ) | ( 1 << MPCM0 ) ) ) | ( 1 << TXC0 );
+	UDR0 = tx_buf[ tail & USART_TX_MASK ];
+	tx_tail = tail + 1;
+	tx_used = 1;
+}
+
+/* The bytes sent before a baud switch are out: switch, and carry on with
+ * whatever was queued since at the new rate. */
+ISR(USART0_TX_vect)
+{
+	UCSR0B &= ~( 1 << TXCIE0 );
+
+	apply_baud( switch_to - 1 );
+	switch_to = 0;
+	tx_used = 0;
+
+	if( tx_head != tx_tail )
+		UCSR0B |= ( 1 << UDRIE0 );
+}
@@ -0,0 +1,114 @@
+/*
+ * usart.h
+ *
+ * USART0 link to the voice recognizer.  Received bytes are queued by the
+ * RX interrupt in a single-producer/single-consumer ring buffer and drained
+ * by the main loop, so nothing is lost while a maneuver is in progress.
+ * Transmission works the other way round: the main loop queues bytes
+ * without waiting and the UDRE interrupt feeds them to the line.  Baud
+ * switches are made by the transmit interrupts as well, between bytes.
+ */
+#ifndef USART_H_
+#define USART_H_
+
+#include <stdint.h>
+
+/* UART calcs */
+#define BAUD 9600UL
+#define MYUBRR (F_CPU/(16*BAUD))-1
+
+/* Line rates selectable at run time with USART_set_baud().  Apart from the
+ * 9600 baud default these are exact divisors of the 20 MHz clock with
+ * double-speed (U2X) enabled.  1 Mbaud has no exact divisor at 20 MHz, so
+ * the fastest rate is 1.25 Mbaud. */
+typedef enum USART_BAUD_TYPE {
+
+	USART_BAUD_9600 = 0,	// UBRR 129, 0.2% error.  Power-up and fallback rate.
+	USART_BAUD_250K,		// U2X, UBRR 9.
+	USART_BAUD_500K,		// U2X, UBRR 4.
+	USART_BAUD_1M25,		// U2X, UBRR 1.
+
+	USART_BAUD_COUNT
+
+} USART_BAUD;
+
+/* Size of the receive ring buffer.  Must be a power of two (2..128) so
+ * indices can wrap with a mask and the fill level fits in a byte. */
+#define USART_RX_SIZE	32
+#define USART_RX_MASK	( USART_RX_SIZE - 1 )
+
+#if ( USART_RX_SIZE < 2 ) || ( USART_RX_SIZE > 128 ) || \
+    ( USART_RX_SIZE & USART_RX_MASK )
+	#error "USART_RX_SIZE must be a power of two between 2 and 128"
+#endif
+
+/* Size of the transmit ring buffer, same rules as USART_RX_SIZE.  Must hold
+ * the largest protocol frame, see proto.c. */
+#define USART_TX_SIZE	128
+#define USART_TX_MASK	( USART_TX_SIZE - 1 )
+
+#if ( USART_TX_SIZE < 2 ) || ( USART_TX_SIZE > 128 ) || \
+    ( USART_TX_SIZE & USART_TX_MASK )
+	#error "USART_TX_SIZE must be a power of two between 2 and 128"
+#endif
+
+/* Receive and transmit path counters, see USART_get_stats() */
+typedef struct USART_STATS_TYPE {
+
+	uint16_t rx_dropped;	// Bytes discarded because the ring was full.
+	uint16_t rx_overruns;	// Hardware data overruns (DOR0) seen by the ISR.
+	uint16_t rx_frame_errors; // Bytes received with a framing error (FE0).
+	uint8_t  rx_peak;		// Highest receive ring fill level.
+	uint16_t tx_dropped;	// Bytes refused because the transmit ring was full.
+	uint8_t  tx_peak;		// Highest transmit ring fill level.
+
+} USART_STATS;
+
+/* Set baud rate, enable the receiver/transmitter and the RX interrupt and
+ * empty the receive ring.  'ubrr' is taken as a normal-speed divisor (U2X
+ * off); pass MYUBRR to start at USART_BAUD_9600. */
+void USART_Init( unsigned int ubrr );
+
+/* Switch the line to 'which' once the bytes queued so far have been sent;
+ * bytes queued later go out at the new rate.  Returns at once: the switch
+ * is made by the transmit interrupts.  Bytes still in the receive ring are
+ * kept. */
+void USART_set_baud( USART_BAUD which );
+
+/* Rate selected by the last USART_set_baud(), even if the switch is still
+ * waiting for the transmitter; USART_BAUD_9600 after USART_Init(). */
+USART_BAUD USART_get_baud( void );
+
+/* Number of received bytes waiting in the ring. */
+uint8_t USART_available( void );
+
+/* Pop one byte into '*pDest'.  Returns 1 if a byte was read, 0 if the ring
+ * was empty. */
+uint8_t USART_getc( uint8_t *pDest );
+
+/* As USART_getc(), also returning the TICK_mark() taken by the RX interrupt
+ * when the byte arrived. */
+uint8_t USART_getc_mark( uint8_t *pDest, uint16_t *pMark );
+
+/* Bulk drain: copy up to 'max' queued bytes into 'pDest' and release them
+ * to the ISR in one step.  Returns the number of bytes copied. */
+uint8_t USART_read( uint8_t *pDest, uint8_t max );
+
+/* Queue one byte for transmission.  Never waits: returns 1 if the byte was
+ * queued, 0 if the transmit ring was full and it was dropped. */
+uint8_t USART_putc( uint8_t data );
+
+/* Queue up to 'len' bytes from 'pSrc'.  Never waits: returns how many were
+ * accepted; the rest are dropped and counted. */
+uint8_t USART_write( const uint8_t *pSrc, uint8_t len );
+
+/* Number of bytes that can be queued right now without dropping any. */
+uint8_t USART_tx_free( void );
+
+/* Snapshot the counters into '*pStats'. */
+void USART_get_stats( USART_STATS *pStats );
+
+/* Reset the counters. */
+void USART_clear_stats( void );
+
+#endif /* USART_H_ */